@@ -0,0 +1,165 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Allocation backends for memory benchmarks
+// Beyond a few MB, random and strided accesses to 4 KB pages are dominated by
+// dTLB misses rather than cache behaviour.  Allocating the same array with
+// different backends shows how much of a result is the TLB:
+//     malloc          : whatever the allocator returns
+//     posix_memalign  : aligned to ALLOC_ALIGNMENT (4 KB pages)
+//     thp             : 2 MB aligned, with madvise(MADV_HUGEPAGE) so the kernel
+//                       backs it with transparent huge pages when it can
+//     hugetlb_2m      : mmap(MAP_HUGETLB) with explicit 2 MB pages
+//     hugetlb_1g      : mmap(MAP_HUGETLB) with explicit 1 GB pages
+// Explicit huge pages must be reserved first, e.g.
+//     echo 512 > /sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages
+// If a backend is unavailable, allocate_buffer fails (rather than quietly
+// using another backend), so results are always labelled correctly.
+//
+// Usage :
+//     alloc_buffer buf;
+//     if (allocate_buffer(&buf, bytes, parse_alloc_backend("thp")) != 0) ...
+//     double* vals = (double*)buf.ptr;
+//     printf("Alloc %s\n", alloc_backend_name(buf.backend));
+//     free_buffer(&buf);
+
+#ifndef ALLOC_ALIGNMENT
+#define ALLOC_ALIGNMENT 4096
+#endif
+
+#define ALLOC_HUGE_2M (2UL << 20)
+#define ALLOC_HUGE_1G (1UL << 30)
+
+typedef enum
+{
+    ALLOC_MALLOC,
+    ALLOC_ALIGNED,
+    ALLOC_THP,
+    ALLOC_HUGETLB_2M,
+    ALLOC_HUGETLB_1G,
+    ALLOC_N_BACKENDS
+} alloc_backend;
+
+static const char* alloc_backend_names[ALLOC_N_BACKENDS] = {
+    "malloc", "posix_memalign", "thp", "hugetlb_2m", "hugetlb_1g"};
+
+typedef struct
+{
+    void* ptr;
+    size_t bytes;           // Bytes requested
+    size_t mapped;          // Bytes mapped (rounded up to the page size for hugetlb)
+    alloc_backend backend;
+} alloc_buffer;
+
+const char* alloc_backend_name(alloc_backend backend)
+{
+    return alloc_backend_names[backend];
+}
+
+// Returns the backend with this name, or -1 (after listing the valid names)
+int parse_alloc_backend(const char* name)
+{
+    for (int i = 0; i < ALLOC_N_BACKENDS; i++)
+        if (strcmp(name, alloc_backend_names[i]) == 0)
+            return i;
+    fprintf(stderr, "Unknown allocation backend %s, use one of:", name);
+    for (int i = 0; i < ALLOC_N_BACKENDS; i++)
+        fprintf(stderr, " %s", alloc_backend_names[i]);
+    fprintf(stderr, "\n");
+    return -1;
+}
+
+size_t alloc_round_up(size_t bytes, size_t page)
+{
+    return (bytes + page - 1) / page * page;
+}
+
+// Returns 0 on success, or -1 (with a message) if the backend is unavailable
+int allocate_buffer(alloc_buffer* buf, size_t bytes, int backend)
+{
+    buf->ptr = NULL;
+    buf->bytes = bytes;
+    buf->mapped = bytes;
+    if (backend < 0 || backend >= ALLOC_N_BACKENDS)
+        return -1;
+    buf->backend = (alloc_backend)backend;
+
+    switch (buf->backend)
+    {
+        case ALLOC_MALLOC:
+            buf->ptr = malloc(bytes);
+            break;
+        case ALLOC_ALIGNED:
+            if (posix_memalign(&buf->ptr, ALLOC_ALIGNMENT, bytes) != 0)
+                buf->ptr = NULL;
+            break;
+        case ALLOC_THP:
+            buf->mapped = alloc_round_up(bytes, ALLOC_HUGE_2M);
+            if (posix_memalign(&buf->ptr, ALLOC_HUGE_2M, buf->mapped) != 0)
+                buf->ptr = NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+            if (buf->ptr && madvise(buf->ptr, buf->mapped, MADV_HUGEPAGE) != 0)
+                fprintf(stderr, "allocator.h : madvise(MADV_HUGEPAGE) failed (%s), "
+                        "check /sys/kernel/mm/transparent_hugepage/enabled\n", strerror(errno));
+#else
+            fprintf(stderr, "allocator.h : MADV_HUGEPAGE not supported, thp uses normal pages\n");
+#endif
+            break;
+        case ALLOC_HUGETLB_2M:
+        case ALLOC_HUGETLB_1G:
+        {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+            int one_gig = buf->backend == ALLOC_HUGETLB_1G;
+            size_t page = one_gig ? ALLOC_HUGE_1G : ALLOC_HUGE_2M;
+            // Page size is encoded as log2(size) << MAP_HUGE_SHIFT (26)
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+                | ((one_gig ? 30 : 21) << 26);
+            buf->mapped = alloc_round_up(bytes, page);
+            void* ptr = mmap(NULL, buf->mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (ptr == MAP_FAILED)
+                fprintf(stderr, "allocator.h : mmap(MAP_HUGETLB) of %zu bytes failed (%s), "
+                        "reserve pages in /sys/kernel/mm/hugepages/hugepages-%s/nr_hugepages\n",
+                        buf->mapped, strerror(errno), one_gig ? "1048576kB" : "2048kB");
+            else
+                buf->ptr = ptr;
+#else
+            fprintf(stderr, "allocator.h : MAP_HUGETLB not supported\n");
+#endif
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (buf->ptr == NULL)
+    {
+        fprintf(stderr, "allocator.h : could not allocate %zu bytes with %s\n",
+                bytes, alloc_backend_name(buf->backend));
+        return -1;
+    }
+    return 0;
+}
+
+void free_buffer(alloc_buffer* buf)
+{
+    if (buf->ptr == NULL)
+        return;
+#if defined(__linux__) && defined(MAP_HUGETLB)
+    if (buf->backend == ALLOC_HUGETLB_2M || buf->backend == ALLOC_HUGETLB_1G)
+        munmap(buf->ptr, buf->mapped);
+    else
+#endif
+        free(buf->ptr);
+    buf->ptr = NULL;
+}
+
+#endif
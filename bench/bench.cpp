@@ -0,0 +1,364 @@
+// Unified benchmark driver
+// Every kernel registered in a kernels_*.cpp file (see registry.hpp) is
+// swept over its sizes and thread counts, timed with the repeat harness in
+// benchmark.h, and reported as one record per (kernel, size, threads).
+//
+// Compile :
+//     g++ -O3 -march=native -fopenmp -o bench bench.cpp kernels_*.cpp
+//
+// Usage :
+//     ./bench [--filter=regex] [--sizes=a,b,c] [--threads=1,2,4]
+//             [--repetitions=N] [--format=csv|json] [--list]
+//             [--save=dir] [--label=name]
+//
+// e.g. ./bench --filter='stream/.*' --threads=1,2,4,8 --format=json > stream.json
+//
+// --save also writes the run (with raw samples) to the results store,
+// <dir>/<host fingerprint>/<label>.json, for later use with compare
+// (see results.hpp and compare.cpp).  The label defaults to the date.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <regex>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../benchmark.h"
+#include "registry.hpp"
+#include "results.hpp"
+
+std::vector<bench_kernel>& bench_registry()
+{
+    // Function-local, so registration in other translation units is safe
+    // regardless of static initialization order
+    static std::vector<bench_kernel> registry;
+    return registry;
+}
+
+std::vector<long> powers_of_two(long first, long last)
+{
+    std::vector<long> sizes;
+    for (long size = first; size <= last; size *= 2)
+        sizes.push_back(size);
+    return sizes;
+}
+
+enum bench_format { BENCH_CSV, BENCH_JSON };
+
+struct bench_options
+{
+    std::string filter;
+    std::vector<long> sizes;        // Empty : each kernel's default sizes
+    std::vector<long> threads;      // Empty : current OpenMP default
+    int repetitions;                // 0 : stop on confidence interval
+    bench_format format;
+    bool list;
+    std::string save_dir;           // Empty : do not save
+    std::string label;              // Empty : date and time
+};
+
+struct bench_result
+{
+    const char* name;
+    long size;
+    int threads;
+    long n_iter;
+    benchmark_stats stats;      // Seconds per iteration
+    double gbs;                 // From the median
+    double gflops;              // From the median, 0 if the kernel has no flops
+    std::vector<double> samples;    // Raw seconds per iteration
+};
+
+std::vector<long> parse_list(const char* arg)
+{
+    std::vector<long> list;
+    std::string s(arg);
+    size_t start = 0;
+    while (start < s.size())
+    {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        if (end > start)
+            list.push_back(atol(s.substr(start, end - start).c_str()));
+        start = end + 1;
+    }
+    return list;
+}
+
+void print_usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s [--filter=regex] [--sizes=a,b,c] [--threads=1,2,4]\n"
+            "           [--repetitions=N] [--format=csv|json] [--list]\n"
+            "           [--save=dir] [--label=name]\n", prog);
+}
+
+int parse_options(int argc, char* argv[], bench_options* opts)
+{
+    opts->filter = ".*";
+    opts->repetitions = 0;
+    opts->format = BENCH_CSV;
+    opts->list = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--filter=", 9) == 0)
+            opts->filter = arg + 9;
+        else if (strncmp(arg, "--sizes=", 8) == 0)
+            opts->sizes = parse_list(arg + 8);
+        else if (strncmp(arg, "--threads=", 10) == 0)
+            opts->threads = parse_list(arg + 10);
+        else if (strncmp(arg, "--repetitions=", 14) == 0)
+            opts->repetitions = atoi(arg + 14);
+        else if (strcmp(arg, "--format=csv") == 0)
+            opts->format = BENCH_CSV;
+        else if (strcmp(arg, "--format=json") == 0)
+            opts->format = BENCH_JSON;
+        else if (strcmp(arg, "--list") == 0)
+            opts->list = true;
+        else if (strncmp(arg, "--save=", 7) == 0)
+            opts->save_dir = arg + 7;
+        else if (strncmp(arg, "--label=", 8) == 0)
+            opts->label = arg + 8;
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+#ifndef _OPENMP
+    if (!opts->threads.empty())
+        fprintf(stderr, "Not compiled with OpenMP, ignoring --threads\n");
+    opts->threads.clear();
+#endif
+    return 0;
+}
+
+int bench_num_threads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+void bench_set_threads(int n_threads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(n_threads);
+#endif
+}
+
+bench_result run_kernel(bench_kernel* kernel, long size, int n_threads,
+        benchmark_config config)
+{
+    bench_result result;
+    result.name = kernel->name;
+    result.size = size;
+    result.threads = n_threads;
+
+    result.samples.resize(config.max_samples);
+    config.samples = result.samples.data();
+
+    void* state = kernel->setup(size);
+    result.n_iter = run_benchmark_calibrated(kernel->run, NULL, state, config, &result.stats);
+    kernel->teardown(state);
+    result.samples.resize(result.stats.n_samples);
+
+    double seconds = result.stats.median;
+    result.gbs = get_grate(get_rate(seconds, (long)kernel->bytes(size)));
+    result.gflops = kernel->flops ? kernel->flops(size) / seconds * 1e-9 : 0;
+    return result;
+}
+
+// Kernel names and CPU models are plain ASCII, but escape quotes and backslashes
+void print_json_string(FILE* f, const char* s)
+{
+    fprintf(f, "\"");
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else fprintf(f, "%c", *s);
+    }
+    fprintf(f, "\"");
+}
+
+// Machine context, so results from different hosts are not confused
+void print_json_context(FILE* f, bench_host* host, const char* date, const char* label)
+{
+    fprintf(f, "{\n  \"schema_version\": %d,\n", BENCH_SCHEMA_VERSION);
+    fprintf(f, "  \"context\": {\n");
+    fprintf(f, "    \"label\": "); print_json_string(f, label); fprintf(f, ",\n");
+    fprintf(f, "    \"fingerprint\": \"%s\",\n", host->fingerprint.c_str());
+    fprintf(f, "    \"host\": "); print_json_string(f, host->host.c_str()); fprintf(f, ",\n");
+    fprintf(f, "    \"cpu\": "); print_json_string(f, host->cpu.c_str()); fprintf(f, ",\n");
+    fprintf(f, "    \"num_cpus\": %ld,\n", host->num_cpus);
+    fprintf(f, "    \"timer\": "); print_json_string(f, get_timer_name()); fprintf(f, ",\n");
+    fprintf(f, "    \"date\": \"%s\"\n", date);
+    fprintf(f, "  },\n  \"benchmarks\": [");
+}
+
+void print_json_result(FILE* f, bench_result* r, bool first)
+{
+    fprintf(f, "%s\n    {\"name\": ", first ? "" : ",");
+    print_json_string(f, r->name);
+    fprintf(f, ", \"size\": %ld, \"threads\": %d, \"n_iter\": %ld, \"n_samples\": %d,\n"
+            "     \"min\": %e, \"median\": %e, \"mean\": %e, \"stddev\": %e, \"cv\": %e,\n"
+            "     \"p90\": %e, \"p99\": %e, \"gbs\": %e, \"gflops\": %e,\n"
+            "     \"samples\": [",
+            r->size, r->threads, r->n_iter, r->stats.n_samples,
+            r->stats.min, r->stats.median, r->stats.mean, r->stats.stddev, r->stats.cv,
+            r->stats.p90, r->stats.p99, r->gbs, r->gflops);
+    for (size_t i = 0; i < r->samples.size(); i++)
+        fprintf(f, "%s%e", i ? ", " : "", r->samples[i]);
+    fprintf(f, "]}");
+}
+
+void print_json_end(FILE* f)
+{
+    fprintf(f, "\n  ]\n}\n");
+}
+
+// mkdir -p for the results store
+int make_dirs(const std::string& path)
+{
+    for (size_t pos = 1; pos <= path.size(); pos++)
+    {
+        if (pos < path.size() && path[pos] != '/')
+            continue;
+        std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "Could not create %s : %s\n", dir.c_str(), strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Write the whole run to <dir>/<fingerprint>/<label>.json
+void save_results(bench_options* opts, bench_host* host, const char* date,
+        std::vector<bench_result>& results)
+{
+    std::string dir = opts->save_dir + "/" + host->fingerprint;
+    if (make_dirs(dir) != 0)
+        return;
+    std::string filename = dir + "/" + opts->label + ".json";
+    FILE* f = fopen(filename.c_str(), "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Could not open %s : %s\n", filename.c_str(), strerror(errno));
+        return;
+    }
+    print_json_context(f, host, date, opts->label.c_str());
+    for (size_t i = 0; i < results.size(); i++)
+        print_json_result(f, &results[i], i == 0);
+    print_json_end(f);
+    fclose(f);
+    fprintf(stderr, "Saved results to %s\n", filename.c_str());
+}
+
+void print_csv_header()
+{
+    printf("name,size,threads,n_iter,n_samples,min,median,mean,stddev,cv,p90,p99,gbs,gflops\n");
+}
+
+void print_csv_result(bench_result* r)
+{
+    printf("%s,%ld,%d,%ld,%d,%e,%e,%e,%e,%e,%e,%e,%e,%e\n",
+            r->name, r->size, r->threads, r->n_iter, r->stats.n_samples,
+            r->stats.min, r->stats.median, r->stats.mean, r->stats.stddev, r->stats.cv,
+            r->stats.p90, r->stats.p99, r->gbs, r->gflops);
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options opts;
+    if (parse_options(argc, argv, &opts) != 0)
+        return 1;
+
+    std::regex filter;
+    try
+    {
+        filter = std::regex(opts.filter);
+    }
+    catch (const std::regex_error& e)
+    {
+        fprintf(stderr, "Invalid --filter %s : %s\n", opts.filter.c_str(), e.what());
+        return 1;
+    }
+
+    std::vector<bench_kernel*> kernels;
+    for (bench_kernel& kernel : bench_registry())
+        if (std::regex_search(kernel.name, filter))
+            kernels.push_back(&kernel);
+
+    if (opts.list)
+    {
+        for (bench_kernel* kernel : kernels)
+            printf("%s\n", kernel->name);
+        return 0;
+    }
+
+    benchmark_config config = default_benchmark_config();
+    if (opts.repetitions > 0)
+    {
+        config.min_samples = opts.repetitions;
+        config.max_samples = opts.repetitions;
+    }
+
+    std::vector<long> threads = opts.threads;
+    if (threads.empty())
+        threads.push_back(bench_num_threads());
+
+    bench_host host = get_bench_host();
+    char date[64];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    if (opts.label.empty())
+        opts.label = date;
+
+    if (opts.format == BENCH_JSON)
+        print_json_context(stdout, &host, date, opts.label.c_str());
+    else
+        print_csv_header();
+
+    std::vector<bench_result> results;
+    for (bench_kernel* kernel : kernels)
+    {
+        const std::vector<long>& sizes = opts.sizes.empty() ? kernel->sizes : opts.sizes;
+        for (long size : sizes)
+        {
+            for (long n_threads : threads)
+            {
+                bench_set_threads(n_threads);
+                bench_result result = run_kernel(kernel, size, n_threads, config);
+                if (opts.format == BENCH_JSON)
+                    print_json_result(stdout, &result, results.empty());
+                else
+                    print_csv_result(&result);
+                fflush(stdout);
+                results.push_back(result);
+            }
+        }
+    }
+
+    if (opts.format == BENCH_JSON)
+        print_json_end(stdout);
+    if (!opts.save_dir.empty())
+        save_results(&opts, &host, date, results);
+
+    return 0;
+}
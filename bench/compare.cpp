@@ -0,0 +1,356 @@
+// Compare saved benchmark runs against a baseline
+// Reads results written by bench --save (see results.hpp), matches records
+// by (name, size, threads), and for each prints the median time of both runs,
+// the speedup (baseline median / candidate median), and a two-sided
+// Mann-Whitney U test on the raw samples.  A record is flagged as a
+// regression when it is slower by more than --threshold and p < --alpha.
+// Works entirely offline on the local results directory.
+//
+// Compile :
+//     g++ -O2 -o compare compare.cpp
+//
+// Usage :
+//     ./compare [--alpha=0.05] [--threshold=0.05] baseline.json candidate.json ...
+//
+// e.g. ./compare results/<fingerprint>/before.json results/<fingerprint>/after.json
+//
+// Exits with status 2 if any candidate regressed, so it can gate a build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "results.hpp"
+
+// Minimal JSON reader, enough for files written by bench
+struct json_value
+{
+    enum { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type;
+    double number;
+    std::string string;
+    std::vector<json_value> array;
+    std::vector<std::pair<std::string, json_value>> object;
+
+    json_value() : type(NUL), number(0) {}
+
+    const json_value* get(const char* key) const
+    {
+        for (const auto& member : object)
+            if (member.first == key)
+                return &member.second;
+        return NULL;
+    }
+};
+
+struct json_parser
+{
+    const char* p;
+    bool ok;
+
+    void skip_space()
+    {
+        while (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r') p++;
+    }
+
+    bool parse_string(std::string& out)
+    {
+        if (*p != '"') return false;
+        p++;
+        while (*p && *p != '"')
+        {
+            if (*p == '\\' && p[1]) p++;
+            out += *p++;
+        }
+        if (*p != '"') return false;
+        p++;
+        return true;
+    }
+
+    bool parse(json_value& v)
+    {
+        skip_space();
+        if (*p == '{')
+        {
+            v.type = json_value::OBJECT;
+            p++;
+            skip_space();
+            if (*p == '}') { p++; return true; }
+            while (1)
+            {
+                std::string key;
+                json_value member;
+                skip_space();
+                if (!parse_string(key)) return false;
+                skip_space();
+                if (*p++ != ':') return false;
+                if (!parse(member)) return false;
+                v.object.push_back(std::make_pair(key, member));
+                skip_space();
+                if (*p == ',') { p++; continue; }
+                if (*p == '}') { p++; return true; }
+                return false;
+            }
+        }
+        else if (*p == '[')
+        {
+            v.type = json_value::ARRAY;
+            p++;
+            skip_space();
+            if (*p == ']') { p++; return true; }
+            while (1)
+            {
+                json_value element;
+                if (!parse(element)) return false;
+                v.array.push_back(element);
+                skip_space();
+                if (*p == ',') { p++; continue; }
+                if (*p == ']') { p++; return true; }
+                return false;
+            }
+        }
+        else if (*p == '"')
+        {
+            v.type = json_value::STRING;
+            return parse_string(v.string);
+        }
+        else if (strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0)
+        {
+            v.type = json_value::BOOL;
+            v.number = (*p == 't');
+            p += (*p == 't') ? 4 : 5;
+            return true;
+        }
+        else if (strncmp(p, "null", 4) == 0)
+        {
+            p += 4;
+            return true;
+        }
+        char* end;
+        v.type = json_value::NUMBER;
+        v.number = strtod(p, &end);
+        if (end == p) return false;
+        p = end;
+        return true;
+    }
+};
+
+struct run_record
+{
+    double median;
+    std::vector<double> samples;
+};
+
+struct run_file
+{
+    std::string filename;
+    std::string label;
+    std::string fingerprint;
+    std::map<std::string, run_record> records;  // Keyed by name/size/threads
+    std::vector<std::string> order;             // Keys in file order
+};
+
+std::string record_key(const json_value& r)
+{
+    const json_value* name = r.get("name");
+    const json_value* size = r.get("size");
+    const json_value* threads = r.get("threads");
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s size=%ld threads=%ld",
+            name ? name->string.c_str() : "?",
+            size ? (long)size->number : 0L, threads ? (long)threads->number : 0L);
+    return buf;
+}
+
+int read_run(const char* filename, run_file* run)
+{
+    FILE* f = fopen(filename, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return -1;
+    }
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+
+    json_value root;
+    json_parser parser = {text.c_str(), true};
+    if (!parser.parse(root) || root.type != json_value::OBJECT)
+    {
+        fprintf(stderr, "%s : not a valid results file\n", filename);
+        return -1;
+    }
+
+    const json_value* version = root.get("schema_version");
+    if (version == NULL || (int)version->number != BENCH_SCHEMA_VERSION)
+    {
+        fprintf(stderr, "%s : schema version %d, expected %d\n", filename,
+                version ? (int)version->number : 0, BENCH_SCHEMA_VERSION);
+        return -1;
+    }
+
+    run->filename = filename;
+    const json_value* context = root.get("context");
+    if (context)
+    {
+        const json_value* label = context->get("label");
+        const json_value* fingerprint = context->get("fingerprint");
+        if (label) run->label = label->string;
+        if (fingerprint) run->fingerprint = fingerprint->string;
+    }
+    if (run->label.empty())
+        run->label = filename;
+
+    const json_value* benchmarks = root.get("benchmarks");
+    if (benchmarks == NULL)
+        return 0;
+    for (const json_value& r : benchmarks->array)
+    {
+        run_record record;
+        const json_value* median = r.get("median");
+        const json_value* samples = r.get("samples");
+        record.median = median ? median->number : 0;
+        if (samples)
+            for (const json_value& s : samples->array)
+                record.samples.push_back(s.number);
+        std::string key = record_key(r);
+        if (run->records.find(key) == run->records.end())
+            run->order.push_back(key);
+        run->records[key] = record;
+    }
+    return 0;
+}
+
+// Two-sided Mann-Whitney U test, with the normal approximation and a
+// correction for ties.  Returns the p-value (1.0 if either side is empty).
+// With only a handful of samples per side the approximation is rough, and
+// the smallest attainable p-value is limited (about 0.008 for 5 vs 5).
+double mann_whitney(const std::vector<double>& x, const std::vector<double>& y)
+{
+    size_t n1 = x.size();
+    size_t n2 = y.size();
+    if (n1 == 0 || n2 == 0)
+        return 1.0;
+
+    std::vector<std::pair<double, int>> all;
+    for (double v : x) all.push_back(std::make_pair(v, 0));
+    for (double v : y) all.push_back(std::make_pair(v, 1));
+    std::sort(all.begin(), all.end());
+
+    // Average ranks over ties
+    size_t n = all.size();
+    double rank_sum_x = 0;
+    double tie_term = 0;
+    for (size_t i = 0; i < n; )
+    {
+        size_t j = i;
+        while (j < n && all[j].first == all[i].first) j++;
+        double rank = 0.5 * (i + 1 + j);
+        for (size_t k = i; k < j; k++)
+            if (all[k].second == 0)
+                rank_sum_x += rank;
+        double t = j - i;
+        tie_term += t*t*t - t;
+        i = j;
+    }
+
+    double u = rank_sum_x - 0.5 * n1 * (n1 + 1);
+    double mean = 0.5 * n1 * n2;
+    double var = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1.0)));
+    if (var <= 0)
+        return 1.0;
+    // Continuity correction
+    double diff = fabs(u - mean) - 0.5;
+    if (diff < 0) diff = 0;
+    double z = diff / sqrt(var);
+    return erfc(z / sqrt(2.0));
+}
+
+// Returns the number of regressions
+int compare_runs(run_file* baseline, run_file* candidate, double alpha, double threshold)
+{
+    printf("Baseline %s, Candidate %s\n", baseline->label.c_str(), candidate->label.c_str());
+    if (baseline->fingerprint != candidate->fingerprint)
+        printf("Warning: host fingerprints differ (%s vs %s), results may not be comparable\n",
+                baseline->fingerprint.c_str(), candidate->fingerprint.c_str());
+    printf("%-48s %12s %12s %9s %9s  %s\n", "Benchmark", "Base Median",
+            "New Median", "Speedup", "p-value", "Result");
+
+    int n_regressions = 0;
+    for (const std::string& key : candidate->order)
+    {
+        auto base = baseline->records.find(key);
+        if (base == baseline->records.end())
+            continue;
+        run_record& b = base->second;
+        run_record& c = candidate->records[key];
+
+        double speedup = c.median > 0 ? b.median / c.median : 0;
+        double p = mann_whitney(b.samples, c.samples);
+        const char* result = "";
+        if (p < alpha && speedup < 1.0 - threshold)
+        {
+            result = "REGRESSION";
+            n_regressions++;
+        }
+        else if (p < alpha && speedup > 1.0 + threshold)
+            result = "improved";
+
+        printf("%-48s %12e %12e %9.3f %9.4f  %s\n", key.c_str(), b.median,
+                c.median, speedup, p, result);
+    }
+    for (const std::string& key : baseline->order)
+        if (candidate->records.find(key) == candidate->records.end())
+            printf("%-48s missing from candidate\n", key.c_str());
+
+    printf("%d regression(s)\n", n_regressions);
+    return n_regressions;
+}
+
+int main(int argc, char* argv[])
+{
+    double alpha = 0.05;
+    double threshold = 0.05;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--alpha=", 8) == 0)
+            alpha = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+            threshold = atof(argv[i] + 12);
+        else
+            files.push_back(argv[i]);
+    }
+
+    if (files.size() < 2)
+    {
+        fprintf(stderr, "Usage: %s [--alpha=0.05] [--threshold=0.05] baseline.json candidate.json ...\n",
+                argv[0]);
+        return 1;
+    }
+
+    run_file baseline;
+    if (read_run(files[0], &baseline) != 0)
+        return 1;
+
+    int n_regressions = 0;
+    for (size_t i = 1; i < files.size(); i++)
+    {
+        run_file candidate;
+        if (read_run(files[i], &candidate) != 0)
+            return 1;
+        if (i > 1) printf("\n");
+        n_regressions += compare_runs(&baseline, &candidate, alpha, threshold);
+    }
+
+    return n_regressions ? 2 : 0;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "registry.hpp"
+
+// Cacheline read/write (see cache/cacheline.c) and random access
+// (see cache/cache_random.c) kernels
+
+struct cache_state
+{
+    volatile double* vals;
+    int* pos;
+    long n;
+    int cacheline_dbl;
+    double result;
+};
+
+int cacheline_doubles()
+{
+    long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (line <= 0) line = 64;
+    return line / sizeof(double);
+}
+
+void* cache_setup(long size)
+{
+    cache_state* s = new cache_state;
+    s->n = size;
+    s->vals = (double*)malloc(size*sizeof(double));
+    s->pos = NULL;
+    s->cacheline_dbl = cacheline_doubles();
+    s->result = 0;
+    for (long i = 0; i < size; i++)
+        s->vals[i] = 1.0;
+    return s;
+}
+
+void* random_setup(long size)
+{
+    cache_state* s = (cache_state*)cache_setup(size);
+    s->pos = (int*)malloc(size*sizeof(int));
+    for (long i = 0; i < size; i++)
+        s->pos[i] = i;
+    // Fisher-Yates shuffle
+    for (long i = size - 1; i > 0; i--)
+    {
+        long j = rand() % (i + 1);
+        int tmp = s->pos[i];
+        s->pos[i] = s->pos[j];
+        s->pos[j] = tmp;
+    }
+    return s;
+}
+
+void cache_teardown(void* state)
+{
+    cache_state* s = (cache_state*)state;
+    free((double*)s->vals);
+    free(s->pos);
+    delete s;
+}
+
+void read_run(void* state, long n_iter)
+{
+    cache_state* s = (cache_state*)state;
+    double sum = 0;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (long i = 0; i < s->n; i++)
+            sum += s->vals[i];
+    s->result = sum;
+}
+
+void read_skip_run(void* state, long n_iter)
+{
+    cache_state* s = (cache_state*)state;
+    double sum = 0;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (int i = 0; i < s->cacheline_dbl; i++)
+            for (long j = i; j < s->n; j += s->cacheline_dbl)
+                sum += s->vals[j];
+    s->result = sum;
+}
+
+void write_run(void* state, long n_iter)
+{
+    cache_state* s = (cache_state*)state;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (long i = 0; i < s->n; i++)
+            s->vals[i] = 1.0;
+}
+
+void write_skip_run(void* state, long n_iter)
+{
+    cache_state* s = (cache_state*)state;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (int i = 0; i < s->cacheline_dbl; i++)
+            for (long j = i; j < s->n; j += s->cacheline_dbl)
+                s->vals[j] = 1.0;
+}
+
+void random_run(void* state, long n_iter)
+{
+    cache_state* s = (cache_state*)state;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (long j = 0; j < s->n; j++)
+            s->vals[s->pos[j]] *= 2;
+}
+
+double one_array(long size) { return 1.0 * sizeof(double) * size; }
+double random_bytes(long size) { return (double)(sizeof(double) + sizeof(int)) * size; }
+
+static std::vector<long> cache_sizes = powers_of_two(1L << 9, 1L << 24);
+
+REGISTER_BENCH(cacheline_read, "cacheline/read", cache_sizes, cache_setup,
+        read_run, cache_teardown, one_array, NULL);
+REGISTER_BENCH(cacheline_read_skip, "cacheline/read_skip", cache_sizes, cache_setup,
+        read_skip_run, cache_teardown, one_array, NULL);
+REGISTER_BENCH(cacheline_write, "cacheline/write", cache_sizes, cache_setup,
+        write_run, cache_teardown, one_array, NULL);
+REGISTER_BENCH(cacheline_write_skip, "cacheline/write_skip", cache_sizes, cache_setup,
+        write_skip_run, cache_teardown, one_array, NULL);
+REGISTER_BENCH(random_access, "random/access", cache_sizes, random_setup,
+        random_run, cache_teardown, random_bytes, NULL);
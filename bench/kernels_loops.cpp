@@ -0,0 +1,109 @@
+#include <stdlib.h>
+
+#include "registry.hpp"
+
+// Loop dependency variants (see vectorize/dependencies.c)
+
+struct loop_state
+{
+    float* x;
+    float* y;
+    float* z;
+    int n;
+};
+
+void* loop_setup(long size)
+{
+    loop_state* s = new loop_state;
+    int n = size;
+    s->n = n;
+    s->x = (float*)malloc(n*sizeof(float));
+    s->y = (float*)malloc(n*sizeof(float));
+    s->z = (float*)malloc(n*sizeof(float));
+    for (int i = 0; i < n; i++)
+    {
+        s->x[i] = 1.0 / (i+1);
+        s->y[i] = 1.0 / (i+1);
+        s->z[i] = 1.0 / (i+1);
+    }
+    return s;
+}
+
+void loop_teardown(void* state)
+{
+    loop_state* s = (loop_state*)state;
+    free(s->x);
+    free(s->y);
+    free(s->z);
+    delete s;
+}
+
+// No dependency : vectorizable
+void independent_run(void* state, long n_iter)
+{
+    loop_state* s = (loop_state*)state;
+    float* x = s->x;
+    float* y = s->y;
+    float* z = s->z;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (int i = 1; i < s->n; i++)
+            z[i] = x[i] * y[i] * z[i];
+}
+
+// Dependency on the previous iteration : not vectorizable
+void dependent_run(void* state, long n_iter)
+{
+    loop_state* s = (loop_state*)state;
+    float* x = s->x;
+    float* y = s->y;
+    float* z = s->z;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (int i = 1; i < s->n; i++)
+            z[i] = x[i] * y[i] * z[i-1];
+}
+
+// Dependency distance of 4 : vectorizable 4 at a time
+void distance4_run(void* state, long n_iter)
+{
+    loop_state* s = (loop_state*)state;
+    float* x = s->x;
+    float* y = s->y;
+    float* z = s->z;
+    for (long iter = 0; iter < n_iter; iter++)
+        for (int i = 4; i < s->n; i++)
+            z[i] = x[i] * y[i] * z[i-4];
+}
+
+// Dependency distance of 4, unrolled by hand
+void unrolled_run(void* state, long n_iter)
+{
+    loop_state* s = (loop_state*)state;
+    float* x = s->x;
+    float* y = s->y;
+    float* z = s->z;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+        for (int i = 4; i < s->n - 3; i += 4)
+        {
+            z[i] = x[i] * y[i] * z[i-4];
+            z[i+1] = x[i+1] * y[i+1] * z[i-3];
+            z[i+2] = x[i+2] * y[i+2] * z[i-2];
+            z[i+3] = x[i+3] * y[i+3] * z[i-1];
+        }
+    }
+}
+
+// Reads x, y, z and writes z
+double loop_bytes(long n) { return 4.0 * sizeof(float) * n; }
+double loop_flops(long n) { return 2.0 * n; }
+
+static std::vector<long> loop_sizes = powers_of_two(1L << 6, 1L << 20);
+
+REGISTER_BENCH(loop_independent, "loops/independent", loop_sizes, loop_setup,
+        independent_run, loop_teardown, loop_bytes, loop_flops);
+REGISTER_BENCH(loop_dependent, "loops/dependent", loop_sizes, loop_setup,
+        dependent_run, loop_teardown, loop_bytes, loop_flops);
+REGISTER_BENCH(loop_distance4, "loops/distance4", loop_sizes, loop_setup,
+        distance4_run, loop_teardown, loop_bytes, loop_flops);
+REGISTER_BENCH(loop_unrolled, "loops/unrolled", loop_sizes, loop_setup,
+        unrolled_run, loop_teardown, loop_bytes, loop_flops);
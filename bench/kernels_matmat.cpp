@@ -0,0 +1,123 @@
+#include <stdlib.h>
+
+#include "registry.hpp"
+
+// Matrix-matrix multiplication variants
+// (see vectorize/matrix_multiply.cpp and openmp/threads.c)
+
+struct matmat_state
+{
+    double* A;
+    double* B;
+    double* C;
+    int n;
+};
+
+void* matmat_setup(long size)
+{
+    matmat_state* s = new matmat_state;
+    int n = size;
+    s->n = n;
+    s->A = (double*)malloc(n*n*sizeof(double));
+    s->B = (double*)malloc(n*n*sizeof(double));
+    s->C = (double*)malloc(n*n*sizeof(double));
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            s->A[i*n+j] = 1.0/(i+1);
+            s->B[i*n+j] = 1.0;
+            s->C[i*n+j] = 0.0;
+        }
+    }
+    return s;
+}
+
+void matmat_teardown(void* state)
+{
+    matmat_state* s = (matmat_state*)state;
+    free(s->A);
+    free(s->B);
+    free(s->C);
+    delete s;
+}
+
+// i-k-j order with restrict pointers, as in vectorize/matrix_multiply.cpp
+void matmat_ikj(int n, double* __restrict__ A, double* __restrict__ B, double* __restrict__ C)
+{
+    double val;
+    for (int i = 0; i < n; i++)
+    {
+        for (int k = 0; k < n; k++)
+            C[i*n+k] = 0;
+        for (int j = 0; j < n; j++)
+        {
+            val = A[i*n+j];
+            for (int k = 0; k < n; k++)
+                C[i*n+k] += val * B[j*n+k];
+        }
+    }
+}
+
+void ikj_run(void* state, long n_iter)
+{
+    matmat_state* s = (matmat_state*)state;
+    for (long iter = 0; iter < n_iter; iter++)
+        matmat_ikj(s->n, s->A, s->B, s->C);
+}
+
+// Dot product (i-j-k) order, as in openmp/threads.c matmult
+void dot_run(void* state, long n_iter)
+{
+    matmat_state* s = (matmat_state*)state;
+    int n = s->n;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+#pragma omp parallel for
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                double val = 0;
+                for (int k = 0; k < n; k++)
+                    val += s->A[i*n+k] * s->B[k*n+j];
+                s->C[i*n+j] = val;
+            }
+        }
+    }
+}
+
+// Out of order (i-k-j) with OpenMP over rows, as in openmp/threads.c matmult_oor
+void oor_run(void* state, long n_iter)
+{
+    matmat_state* s = (matmat_state*)state;
+    int n = s->n;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+#pragma omp parallel for
+        for (int i = 0; i < n; i++)
+        {
+            for (int k = 0; k < n; k++)
+                s->C[i*n+k] = 0;
+            for (int j = 0; j < n; j++)
+            {
+                double val = s->A[i*n+j];
+                for (int k = 0; k < n; k++)
+                    s->C[i*n+k] += val*s->B[j*n+k];
+            }
+        }
+    }
+}
+
+// At least A, B, and C move to/from memory once
+double matmat_bytes(long n) { return 3.0 * sizeof(double) * n * n; }
+double matmat_flops(long n) { return 2.0 * n * n * n; }
+
+static std::vector<long> matmat_sizes = powers_of_two(16, 512);
+
+REGISTER_BENCH(matmat_ikj, "matmat/ikj", matmat_sizes, matmat_setup, ikj_run,
+        matmat_teardown, matmat_bytes, matmat_flops);
+REGISTER_BENCH(matmat_dot, "matmat/dot_omp", matmat_sizes, matmat_setup, dot_run,
+        matmat_teardown, matmat_bytes, matmat_flops);
+REGISTER_BENCH(matmat_oor, "matmat/oor_omp", matmat_sizes, matmat_setup, oor_run,
+        matmat_teardown, matmat_bytes, matmat_flops);
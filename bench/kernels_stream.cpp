@@ -0,0 +1,102 @@
+#include <stdlib.h>
+
+#include "registry.hpp"
+
+// STREAM Copy, Scale, Add, and Triad (see cache/stream.c)
+// The array range (not repetitions) is split across OpenMP threads
+
+struct stream_state
+{
+    double* a;
+    double* b;
+    double* c;
+    long n;
+};
+
+void* stream_setup(long size)
+{
+    stream_state* s = new stream_state;
+    s->n = size;
+    s->a = (double*)malloc(size*sizeof(double));
+    s->b = (double*)malloc(size*sizeof(double));
+    s->c = (double*)malloc(size*sizeof(double));
+#pragma omp parallel for
+    for (long j = 0; j < size; j++)
+    {
+        s->a[j] = 1.0;
+        s->b[j] = 2.0;
+        s->c[j] = 0.0;
+    }
+    return s;
+}
+
+void stream_teardown(void* state)
+{
+    stream_state* s = (stream_state*)state;
+    free(s->a);
+    free(s->b);
+    free(s->c);
+    delete s;
+}
+
+void copy_run(void* state, long n_iter)
+{
+    stream_state* s = (stream_state*)state;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+#pragma omp parallel for
+        for (long j = 0; j < s->n; j++)
+            s->c[j] = s->a[j];
+    }
+}
+
+void scale_run(void* state, long n_iter)
+{
+    stream_state* s = (stream_state*)state;
+    double scalar = 3.0;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+#pragma omp parallel for
+        for (long j = 0; j < s->n; j++)
+            s->b[j] = scalar*s->c[j];
+    }
+}
+
+void add_run(void* state, long n_iter)
+{
+    stream_state* s = (stream_state*)state;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+#pragma omp parallel for
+        for (long j = 0; j < s->n; j++)
+            s->c[j] = s->a[j]+s->b[j];
+    }
+}
+
+void triad_run(void* state, long n_iter)
+{
+    stream_state* s = (stream_state*)state;
+    double scalar = 3.0;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+#pragma omp parallel for
+        for (long j = 0; j < s->n; j++)
+            s->a[j] = s->b[j]+scalar*s->c[j];
+    }
+}
+
+double two_arrays(long size) { return 2.0 * sizeof(double) * size; }
+double three_arrays(long size) { return 3.0 * sizeof(double) * size; }
+double one_flop(long size) { return size; }
+double two_flops(long size) { return 2.0 * size; }
+
+static std::vector<long> stream_sizes = powers_of_two(1L << 10, 1L << 24);
+
+REGISTER_BENCH(copy, "stream/copy", stream_sizes, stream_setup, copy_run,
+        stream_teardown, two_arrays, NULL);
+REGISTER_BENCH(scale, "stream/scale", stream_sizes, stream_setup, scale_run,
+        stream_teardown, two_arrays, one_flop);
+REGISTER_BENCH(add, "stream/add", stream_sizes, stream_setup, add_run,
+        stream_teardown, three_arrays, one_flop);
+REGISTER_BENCH(triad, "stream/triad", stream_sizes, stream_setup, triad_run,
+        stream_teardown, three_arrays, two_flops);
@@ -0,0 +1,49 @@
+#ifndef BENCH_REGISTRY_HPP
+#define BENCH_REGISTRY_HPP
+
+#include <vector>
+
+// Kernel registry for the benchmark driver
+// Each kernel registers a name, its default parameter space (sizes), and
+// setup/run/teardown methods.  The driver calibrates n_iter, times run()
+// with the repeat harness, and reports bytes and flops per iteration as rates.
+//
+// Registering a kernel (in any kernels_*.cpp file):
+//     REGISTER_BENCH(triad, "stream/triad", stream_sizes, stream_setup,
+//             triad_run, stream_teardown, triad_bytes, triad_flops);
+
+// Setup returns the kernel's state, allocated for one size
+typedef void* (*bench_setup)(long size);
+typedef void (*bench_run)(void* state, long n_iter);
+typedef void (*bench_teardown)(void* state);
+// Bytes moved or flops performed by one iteration of run()
+typedef double (*bench_count)(long size);
+
+struct bench_kernel
+{
+    const char* name;
+    std::vector<long> sizes;    // Default sizes, overridden by --sizes
+    bench_setup setup;
+    bench_run run;
+    bench_teardown teardown;
+    bench_count bytes;
+    bench_count flops;          // NULL for kernels with no floating point work
+};
+
+std::vector<bench_kernel>& bench_registry();
+
+struct bench_register
+{
+    bench_register(bench_kernel kernel)
+    {
+        bench_registry().push_back(kernel);
+    }
+};
+
+#define REGISTER_BENCH(id, name, sizes, setup, run, teardown, bytes, flops) \
+    static bench_register bench_register_##id({name, sizes, setup, run, teardown, bytes, flops})
+
+// Size sweeps shared by several kernel files
+std::vector<long> powers_of_two(long first, long last);
+
+#endif
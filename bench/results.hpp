@@ -0,0 +1,88 @@
+#ifndef BENCH_RESULTS_HPP
+#define BENCH_RESULTS_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+// Results store shared by the driver (bench --save) and compare
+// Each run is one JSON file, <dir>/<host fingerprint>/<label>.json, holding
+// the schema version, machine context, and every (name, size, threads)
+// record with its raw per-iteration samples.  Files are plain JSON in a
+// local directory, so the store can be versioned, copied, or diffed.
+//
+// Bump BENCH_SCHEMA_VERSION whenever a field changes meaning, so compare
+// refuses to mix incompatible files.
+
+#define BENCH_SCHEMA_VERSION 1
+
+struct bench_host
+{
+    std::string host;
+    std::string cpu;
+    long num_cpus;
+    std::string fingerprint;    // Hash of cpu model and num_cpus
+};
+
+inline std::string get_cpu_model()
+{
+    std::string model = "unknown";
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) return model;
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, "model name", 10) == 0)
+        {
+            char* value = strchr(line, ':');
+            if (value)
+            {
+                value++;
+                while (*value == ' ') value++;
+                value[strcspn(value, "\n")] = '\0';
+                model = value;
+            }
+            break;
+        }
+    }
+    fclose(f);
+    return model;
+}
+
+// FNV-1a, stable across compilers and runs (unlike std::hash)
+inline uint64_t fnv1a(const std::string& s, uint64_t hash = 14695981039346656037ULL)
+{
+    for (unsigned char c : s)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Nodes of one cluster partition share a fingerprint, so results from any of
+// them can be compared; the hostname is recorded but not part of the key
+inline std::string host_fingerprint(const std::string& cpu, long num_cpus)
+{
+    char buf[32];
+    uint64_t hash = fnv1a(cpu + "/" + std::to_string(num_cpus));
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+    return buf;
+}
+
+inline bench_host get_bench_host()
+{
+    bench_host h;
+    char host[256];
+    if (gethostname(host, sizeof(host)) != 0)
+        snprintf(host, sizeof(host), "unknown");
+    h.host = host;
+    h.cpu = get_cpu_model();
+    h.num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    h.fingerprint = host_fingerprint(h.cpu, h.num_cpus);
+    return h;
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "timer.h"
+
+// Repeat harness for timed kernels
+// A single timing on a shared node can easily vary by 20-30%, so instead
+// a kernel is run many times: the first few runs are discarded as warm-up,
+// and the rest are summarized by min, median, percentiles, and spread.
+// Runs stop early once the 95% confidence interval of the mean is tight enough.
+//
+// Usage :
+//     void my_kernel(void* data) { ... }
+//     benchmark_config config = default_benchmark_config();
+//     benchmark_stats stats;
+//     run_benchmark(my_kernel, NULL, &my_data, config, &stats);
+//     print_stats("My Kernel", &stats);
+//
+// Kernels that take an iteration count can instead be calibrated, growing
+// n_iter until one sample takes config.target_seconds, so that tiny and huge
+// problem sizes both take a predictable amount of time:
+//     void my_kernel(void* data, long n_iter) { ... }
+//     long n_iter = run_benchmark_calibrated(my_kernel, NULL, &my_data, config, &stats);
+//     // stats now hold seconds per iteration
+//
+// To keep the raw samples (e.g. for significance tests between runs), point
+// config.samples at an array of config.max_samples doubles.
+//
+// Statistics use sqrt, so link with -lm (e.g. gcc -O2 -o cacheline cacheline.c -lm)
+
+// A kernel to be timed, or a reset method to be called (untimed) before each run
+typedef void (*benchmark_kernel)(void* data);
+
+// A method that runs and times the kernel itself, returning seconds
+// (e.g. when the time must be reduced across MPI processes)
+typedef double (*benchmark_sampler)(void* data);
+
+// A kernel that runs n_iter iterations of its work
+typedef void (*benchmark_iter_kernel)(void* data, long n_iter);
+
+// Default time per sample for calibrated runs
+// Can be set on the compile line, e.g. -DBENCHMARK_TARGET_SECONDS=0.5
+#ifndef BENCHMARK_TARGET_SECONDS
+#define BENCHMARK_TARGET_SECONDS 0.1
+#endif
+
+typedef struct
+{
+    int n_warmup;       // Runs to discard before recording samples
+    int min_samples;    // Always record at least this many samples
+    int max_samples;    // Never record more than this many samples
+    double rel_ci;      // Stop once 95% CI half-width / mean falls below this
+    double target_seconds;  // Calibrated runs grow n_iter until a sample takes this long
+    double* samples;    // If not NULL, raw samples are copied here (room for max_samples)
+} benchmark_config;
+
+typedef struct
+{
+    int n_samples;
+    double min, max, mean, median;
+    double p90, p99;
+    double stddev;
+    double cv;          // Coefficient of variation (stddev / mean)
+    double rel_ci;      // 95% CI half-width of the mean, relative to the mean
+} benchmark_stats;
+
+benchmark_config default_benchmark_config()
+{
+    benchmark_config config;
+    config.n_warmup = 1;
+    config.min_samples = 5;
+    config.max_samples = 50;
+    config.rel_ci = 0.01;
+    config.target_seconds = BENCHMARK_TARGET_SECONDS;
+    config.samples = NULL;
+    return config;
+}
+
+// Two-sided 95% Student-t critical values, for df = 1 ... 30
+static const double t_critical_95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+double t_critical(int df)
+{
+    if (df < 1) return INFINITY;
+    if (df <= 30) return t_critical_95[df-1];
+    return 1.96;
+}
+
+int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Returns the p-th percentile (0 <= p <= 100) of sorted values,
+// interpolating linearly between neighbors
+double percentile(double* sorted, int n, double p)
+{
+    if (n == 0) return 0;
+    double pos = (p / 100.0) * (n - 1);
+    int lo = (int)pos;
+    if (lo >= n - 1) return sorted[n-1];
+    double frac = pos - lo;
+    return sorted[lo] + frac * (sorted[lo+1] - sorted[lo]);
+}
+
+// Relative 95% CI half-width of the mean of samples
+double relative_ci(double* samples, int n)
+{
+    if (n < 2) return INFINITY;
+    double mean = 0, var = 0;
+    for (int i = 0; i < n; i++)
+        mean += samples[i];
+    mean /= n;
+    for (int i = 0; i < n; i++)
+        var += (samples[i] - mean) * (samples[i] - mean);
+    var /= (n - 1);
+    if (mean == 0) return 0;
+    return t_critical(n-1) * sqrt(var / n) / mean;
+}
+
+// Summarize n samples (in seconds)
+void compute_stats(double* samples, int n, benchmark_stats* stats)
+{
+    double* sorted = (double*)malloc(n*sizeof(double));
+    double mean = 0, var = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sorted[i] = samples[i];
+        mean += samples[i];
+    }
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    mean /= n;
+    for (int i = 0; i < n; i++)
+        var += (samples[i] - mean) * (samples[i] - mean);
+    if (n > 1) var /= (n - 1);
+
+    stats->n_samples = n;
+    stats->min = sorted[0];
+    stats->max = sorted[n-1];
+    stats->mean = mean;
+    stats->median = percentile(sorted, n, 50);
+    stats->p90 = percentile(sorted, n, 90);
+    stats->p99 = percentile(sorted, n, 99);
+    stats->stddev = sqrt(var);
+    stats->cv = mean > 0 ? stats->stddev / mean : 0;
+    stats->rel_ci = relative_ci(samples, n);
+
+    free(sorted);
+}
+
+// Multiply every time in stats by factor (e.g. to get time per iteration)
+void scale_stats(benchmark_stats* stats, double factor)
+{
+    stats->min *= factor;
+    stats->max *= factor;
+    stats->mean *= factor;
+    stats->median *= factor;
+    stats->p90 *= factor;
+    stats->p99 *= factor;
+    stats->stddev *= factor;
+}
+
+// Run sampler (which returns its own timing) until enough samples are collected
+void run_benchmark_samples(benchmark_sampler sampler, void* data,
+        benchmark_config config, benchmark_stats* stats)
+{
+    if (config.max_samples < 1) config.max_samples = 1;
+    if (config.min_samples > config.max_samples) config.min_samples = config.max_samples;
+
+    double* samples = (double*)malloc(config.max_samples*sizeof(double));
+    int n = 0;
+
+    for (int i = 0; i < config.n_warmup; i++)
+        sampler(data);
+
+    while (n < config.max_samples)
+    {
+        samples[n++] = sampler(data);
+        if (n >= config.min_samples && n >= 2 && relative_ci(samples, n) < config.rel_ci)
+            break;
+    }
+
+    if (config.samples)
+        for (int i = 0; i < n; i++)
+            config.samples[i] = samples[i];
+    compute_stats(samples, n, stats);
+    free(samples);
+}
+
+typedef struct
+{
+    benchmark_kernel kernel;
+    benchmark_kernel reset;
+    void* data;
+} benchmark_timed_kernel;
+
+double benchmark_time_kernel(void* data)
+{
+    benchmark_timed_kernel* k = (benchmark_timed_kernel*)data;
+    if (k->reset) k->reset(k->data);
+    double start = get_time();
+    k->kernel(k->data);
+    double end = get_time();
+    return get_seconds(start, end);
+}
+
+// Time kernel repeatedly, calling reset (if not NULL) before every run
+void run_benchmark(benchmark_kernel kernel, benchmark_kernel reset, void* data,
+        benchmark_config config, benchmark_stats* stats)
+{
+    benchmark_timed_kernel k;
+    k.kernel = kernel;
+    k.reset = reset;
+    k.data = data;
+    run_benchmark_samples(benchmark_time_kernel, &k, config, stats);
+}
+
+typedef struct
+{
+    benchmark_iter_kernel kernel;
+    benchmark_kernel reset;
+    void* data;
+    long n_iter;
+} benchmark_calibrated_kernel;
+
+double benchmark_time_iter_kernel(void* data)
+{
+    benchmark_calibrated_kernel* k = (benchmark_calibrated_kernel*)data;
+    if (k->reset) k->reset(k->data);
+    double start = get_time();
+    k->kernel(k->data, k->n_iter);
+    double end = get_time();
+    return get_seconds(start, end);
+}
+
+// Find n_iter so that one call to kernel takes at least target_seconds
+// Like Google Benchmark, n_iter grows by the ratio of target to measured time
+// (with some headroom), but by at most 10x per step in case a run was
+// too short to measure accurately
+long calibrate_iterations(benchmark_iter_kernel kernel, benchmark_kernel reset,
+        void* data, double target_seconds)
+{
+    benchmark_calibrated_kernel k;
+    k.kernel = kernel;
+    k.reset = reset;
+    k.data = data;
+    k.n_iter = 1;
+
+    while (1)
+    {
+        double seconds = benchmark_time_iter_kernel(&k);
+        if (seconds >= target_seconds || k.n_iter >= (1L << 40))
+            break;
+
+        double multiplier = 10;
+        if (seconds / target_seconds > 0.1)
+            multiplier = 1.4 * target_seconds / seconds;
+        if (multiplier < 1.1) multiplier = 1.1;
+        long next = (long)(k.n_iter * multiplier);
+        k.n_iter = next > k.n_iter ? next : k.n_iter + 1;
+    }
+    return k.n_iter;
+}
+
+// Calibrate n_iter, then time kernel repeatedly with that n_iter
+// Stats are returned in seconds per iteration, and n_iter is returned
+long run_benchmark_calibrated(benchmark_iter_kernel kernel, benchmark_kernel reset,
+        void* data, benchmark_config config, benchmark_stats* stats)
+{
+    benchmark_calibrated_kernel k;
+    k.kernel = kernel;
+    k.reset = reset;
+    k.data = data;
+    k.n_iter = calibrate_iterations(kernel, reset, data, config.target_seconds);
+
+    // Calibration already warmed up the kernel
+    config.n_warmup = 0;
+    run_benchmark_samples(benchmark_time_iter_kernel, &k, config, stats);
+    scale_stats(stats, 1.0 / k.n_iter);
+    if (config.samples)
+        for (int i = 0; i < stats->n_samples; i++)
+            config.samples[i] /= k.n_iter;
+    return k.n_iter;
+}
+
+// Print a one-line summary of stats, in seconds
+void print_stats(const char* label, benchmark_stats* stats)
+{
+    printf("%s: n %d, Min %e, Median %e, P90 %e, P99 %e, Stddev %e, CV %.2f%%\n",
+            label, stats->n_samples, stats->min, stats->median,
+            stats->p90, stats->p99, stats->stddev, 100.0*stats->cv);
+}
+
+#endif
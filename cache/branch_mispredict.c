@@ -1,10 +1,38 @@
-
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BRANCH_SIMD_X86
+#include <immintrin.h>
+#endif
 
-// Import timer.h (the other file I have uploaded) 
+// Import timer.h (the other file I have uploaded)
 // as it has all of the timing methods
 #include "../timer.h"
+#include "../counters.h"
+#include "../topology.h"
+
+// The L/U copy is timed with an 'if' in the inner loop, with the loop split
+// at the diagonal, and with branchless versions for when the loop cannot be
+// split : selecting the destination by index, and (x86) AVX2 blends and
+// AVX-512 masked stores.  Every version is OpenMP-parallel over rows.
+// Then the same branchless versions are timed on a data-dependent filter
+// (sum of the values >= FILTER_THRESHOLD) over sorted and shuffled input,
+// where only the 'if' version depends on how predictable the branch is.
+//
+// Compile : gcc -O2 -fopenmp -o branch_mispredict branch_mispredict.c -lm
+// Counters (counters.h) count the calling thread only, so with more than
+// one thread the L/U copy counters cover thread 0's share, and are printed
+// per element of that share.
+
+#define FILTER_VALS (1 << 16)
+#define FILTER_PASSES 2000
+#define FILTER_THRESHOLD 128
 
 
 // Vector norm method ... just for checking that results are consistent
@@ -26,26 +54,41 @@ void reset_vectors(double* A, double* L, double* U, int n_vals)
     }
 }
 
+int thread_num()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
 
-// This is the main method that will be executed when running the program
-int main(int argc, char* argv[])
+int num_threads()
 {
-    // Declare three large arrays
-    int n_vals = 50000;
-    double* A_vals = (double*)malloc(n_vals*sizeof(double));
-    double* L_vals = (double*)malloc(n_vals*sizeof(double));
-    double* U_vals = (double*)malloc(n_vals*sizeof(double));
-    double sum_L, sum_U;
-    double start, end;
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+// Rows [lo, hi) of thread t for a lower triangle, where row i has i+1
+// elements.  Thread t gets rows up to n*sqrt((t+1)/n_threads), so every
+// thread copies the same number of elements.
+void triangle_rows(int n, int t, int n_threads, int* lo, int* hi)
+{
+    *lo = (int)(n * sqrt((double)t / n_threads));
+    *hi = (int)(n * sqrt((double)(t + 1) / n_threads));
+}
 
 
-    // Initialize the arrays
-    reset_vectors(A_vals, L_vals, U_vals, n_vals);
+// L/U copy variants
+// Each leaves L[i] = A[n-1] (the last j > i) and U[i] = A[i] (the last j <= i)
 
-    // Time a loop that copies values A to appropriate vector
-    // Using 'if' statments
-    printf("Copying values with 'if' statements\n");
-    start = get_time();
+void copy_if(double* A_vals, double* L_vals, double* U_vals, int n_vals)
+{
+    // Every row has n_vals elements, so a static schedule is balanced
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < n_vals; i++)
     {
         for (int j = 0; j < n_vals; j++)
@@ -60,38 +103,343 @@ int main(int argc, char* argv[])
             }
         }
     }
-    end = get_time();
-    sum_L = norm(L_vals, n_vals);
-    sum_U = norm(U_vals, n_vals);
-    printf("Norm L %e, Norm U %e\n", sum_L, sum_U); // error checking
-    printf("Elapsed %e\n\n", end - start);
+}
+
+void copy_split(double* A_vals, double* L_vals, double* U_vals, int n_vals)
+{
+    // Split, the U and L loops are each a triangle, so a static schedule
+    // over rows would give the last thread most of the U copies and the
+    // first thread most of the L copies.  Partition each triangle by area
+    // instead (the L triangle is the U triangle mirrored).
+#pragma omp parallel
+    {
+        int lo, hi;
+        triangle_rows(n_vals, thread_num(), num_threads(), &lo, &hi);
+        for (int i = lo; i < hi; i++)
+        {
+            for (int j = 0; j <= i; j++)
+            {
+                U_vals[i] = A_vals[j];
+            }
+        }
+        for (int i = n_vals - hi; i < n_vals - lo; i++)
+        {
+            for (int j = i+1; j < n_vals; j++)
+            {
+                L_vals[i] = A_vals[j];
+            }
+        }
+    }
+}
+
+void copy_select(double* A_vals, double* L_vals, double* U_vals, int n_vals)
+{
+    // The comparison indexes the destination, so there is no branch to predict
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n_vals; i++)
+    {
+        double* dst[2] = {U_vals, L_vals};
+        for (int j = 0; j < n_vals; j++)
+        {
+            dst[i < j][i] = A_vals[j];
+        }
+    }
+}
+
+#ifdef BRANCH_SIMD_X86
+// The vector versions swap the loops, so each A[j] is blended into a block
+// of rows i at once (j is the outer loop, so the last write still wins).
+// Each thread owns a contiguous block of rows.
+
+__attribute__((target("avx2")))
+void copy_avx2(double* A_vals, double* L_vals, double* U_vals, int n_vals)
+{
+#pragma omp parallel
+    {
+        int t = thread_num();
+        int n_threads = num_threads();
+        int lo = (int)((long)n_vals * t / n_threads);
+        int hi = (int)((long)n_vals * (t + 1) / n_threads);
+        __m256i step = _mm256_set_epi64x(3, 2, 1, 0);
+        for (int j = 0; j < n_vals; j++)
+        {
+            __m256d a = _mm256_set1_pd(A_vals[j]);
+            __m256i jv = _mm256_set1_epi64x(j);
+            int i = lo;
+            for (; i + 4 <= hi; i += 4)
+            {
+                __m256i iv = _mm256_add_epi64(_mm256_set1_epi64x(i), step);
+                __m256d lower = _mm256_castsi256_pd(_mm256_cmpgt_epi64(jv, iv));   // i < j
+                _mm256_storeu_pd(&L_vals[i], _mm256_blendv_pd(_mm256_loadu_pd(&L_vals[i]), a, lower));
+                _mm256_storeu_pd(&U_vals[i], _mm256_blendv_pd(a, _mm256_loadu_pd(&U_vals[i]), lower));
+            }
+            for (; i < hi; i++)
+            {
+                double* dst[2] = {U_vals, L_vals};
+                dst[i < j][i] = A_vals[j];
+            }
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+void copy_avx512(double* A_vals, double* L_vals, double* U_vals, int n_vals)
+{
+#pragma omp parallel
+    {
+        int t = thread_num();
+        int n_threads = num_threads();
+        int lo = (int)((long)n_vals * t / n_threads);
+        int hi = (int)((long)n_vals * (t + 1) / n_threads);
+        __m512i step = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+        for (int j = 0; j < n_vals; j++)
+        {
+            __m512d a = _mm512_set1_pd(A_vals[j]);
+            __m512i jv = _mm512_set1_epi64(j);
+            int i = lo;
+            for (; i + 8 <= hi; i += 8)
+            {
+                __m512i iv = _mm512_add_epi64(_mm512_set1_epi64(i), step);
+                __mmask8 lower = _mm512_cmplt_epi64_mask(iv, jv);   // i < j
+                _mm512_mask_storeu_pd(&L_vals[i], lower, a);
+                _mm512_mask_storeu_pd(&U_vals[i], (__mmask8)~lower, a);
+            }
+            for (; i < hi; i++)
+            {
+                double* dst[2] = {U_vals, L_vals};
+                dst[i < j][i] = A_vals[j];
+            }
+        }
+    }
+}
+#endif
 
 
+// Data-dependent filter variants : sum of vals[i] >= FILTER_THRESHOLD
 
-    // Initialize the arrays
-    reset_vectors(A_vals, L_vals, U_vals, n_vals);
+double filter_if(double* vals, int n_vals)
+{
+    double sum = 0;
+    for (int i = 0; i < n_vals; i++)
+        if (vals[i] >= FILTER_THRESHOLD)
+            sum += vals[i];
+    return sum;
+}
 
-    // Time a loop that copies values A to appropriate vector
-    // NOT using 'if' statments
-    printf("Copying values without 'if' statements\n");    
-    start = get_time();
+double filter_select(double* vals, int n_vals)
+{
+    // The comparison becomes an all-ones or all-zeros mask over the value's
+    // bits (multiplying by the comparison instead is compiled to a branch)
+    double sum = 0;
     for (int i = 0; i < n_vals; i++)
     {
-        for (int j = 0; j <= i; j++)
+        uint64_t bits;
+        memcpy(&bits, &vals[i], sizeof(bits));
+        bits &= -(uint64_t)(vals[i] >= FILTER_THRESHOLD);
+        double kept;
+        memcpy(&kept, &bits, sizeof(kept));
+        sum += kept;
+    }
+    return sum;
+}
+
+#ifdef BRANCH_SIMD_X86
+__attribute__((target("avx2")))
+double filter_avx2(double* vals, int n_vals)
+{
+    __m256d threshold = _mm256_set1_pd(FILTER_THRESHOLD);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d sum4 = zero;
+    int i = 0;
+    for (; i + 4 <= n_vals; i += 4)
+    {
+        __m256d v = _mm256_loadu_pd(&vals[i]);
+        __m256d keep = _mm256_cmp_pd(v, threshold, _CMP_GE_OQ);
+        sum4 = _mm256_add_pd(sum4, _mm256_blendv_pd(zero, v, keep));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum4);
+    double sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return sum + filter_select(&vals[i], n_vals - i);
+}
+
+__attribute__((target("avx512f")))
+double filter_avx512(double* vals, int n_vals)
+{
+    __m512d threshold = _mm512_set1_pd(FILTER_THRESHOLD);
+    __m512d sum8 = _mm512_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= n_vals; i += 8)
+    {
+        __m512d v = _mm512_loadu_pd(&vals[i]);
+        __mmask8 keep = _mm512_cmp_pd_mask(v, threshold, _CMP_GE_OQ);
+        sum8 = _mm512_mask_add_pd(sum8, keep, sum8, v);
+    }
+    double sum = _mm512_reduce_add_pd(sum8);
+    return sum + filter_select(&vals[i], n_vals - i);
+}
+#endif
+
+int simd_supported(const char* name)
+{
+#ifdef BRANCH_SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+#endif
+    return strcmp(name, "avx2") != 0 && strcmp(name, "avx512") != 0;
+}
+
+typedef void (*copy_variant)(double* A, double* L, double* U, int n_vals);
+typedef double (*filter_variant)(double* vals, int n_vals);
+typedef long (*share_elements)(int n_vals, int n_threads);
+
+// Elements of the L/U copy done by thread 0, for each way of splitting rows
+// A static schedule gives the first n_vals % n_threads threads one more row
+long static_rows_elements(int n_vals, int n_threads)
+{
+    return (long)((n_vals + n_threads - 1) / n_threads) * n_vals;
+}
+
+long block_rows_elements(int n_vals, int n_threads)
+{
+    return (long)(n_vals / n_threads) * n_vals;
+}
+
+// Rows [0, hi) of the U triangle hold hi(hi+1)/2 elements, and the mirrored
+// rows of the L triangle hi(hi-1)/2
+long triangle_elements(int n_vals, int n_threads)
+{
+    int lo, hi;
+    triangle_rows(n_vals, 0, n_threads, &lo, &hi);
+    return (long)hi * hi;
+}
+
+typedef struct
+{
+    const char* name;
+    const char* description;
+    copy_variant copy;
+    share_elements thread0_elements;
+    filter_variant filter;
+} branch_variant;
+
+static branch_variant variants[] = {
+    {"if", "with 'if' statements", copy_if, static_rows_elements, filter_if},
+    {"split", "without 'if' statements (loop split)", copy_split, triangle_elements, NULL},
+    {"select", "selecting the destination by index", copy_select, static_rows_elements,
+        filter_select},
+#ifdef BRANCH_SIMD_X86
+    {"avx2", "with AVX2 blends", copy_avx2, block_rows_elements, filter_avx2},
+    {"avx512", "with AVX-512 masked stores", copy_avx512, block_rows_elements, filter_avx512},
+#endif
+};
+
+
+// This is the main method that will be executed when running the program
+int main(int argc, char* argv[])
+{
+    // Declare three large arrays
+    int n_vals = 50000;
+    double* A_vals = (double*)malloc(n_vals*sizeof(double));
+    double* L_vals = (double*)malloc(n_vals*sizeof(double));
+    double* U_vals = (double*)malloc(n_vals*sizeof(double));
+    double sum_L, sum_U;
+    double start, end;
+    int n_variants = sizeof(variants) / sizeof(variants[0]);
+    int n_threads = 1;
+
+    // Hardware counters show whether the 'if' version pays in branch misses
+    perf_counters counters;
+    counters_init(&counters);
+
+#ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+    printf("Threads %d\n\n", n_threads);
+#endif
+
+    for (int v = 0; v < n_variants; v++)
+    {
+        if (!simd_supported(variants[v].name))
+        {
+            printf("Copying values %s : not supported on this CPU\n\n", variants[v].description);
+            continue;
+        }
+
+        // Initialize the arrays
+        reset_vectors(A_vals, L_vals, U_vals, n_vals);
+
+        // Time a loop that copies values A to appropriate vector
+        printf("Copying values %s\n", variants[v].description);
+        counters_start(&counters);
+        start = get_time();
+        variants[v].copy(A_vals, L_vals, U_vals, n_vals);
+        end = get_time();
+        counters_stop(&counters);
+        sum_L = norm(L_vals, n_vals);
+        sum_U = norm(U_vals, n_vals);
+        printf("Norm L %e, Norm U %e\n", sum_L, sum_U); // error checking
+        printf("Elapsed %s %e\n", variants[v].name, end - start);
+        print_counters(&counters, variants[v].thread0_elements(n_vals, n_threads));
+        printf("\n");
+    }
+
+
+    // The filter branches on the data, not the loop index : sorted input
+    // takes the same side for half the array at a time, shuffled input
+    // takes a random side every time
+    double* vals = (double*)malloc(FILTER_VALS*sizeof(double));
+    long n_filtered = (long)FILTER_VALS * FILTER_PASSES;
+    printf("Summing values >= %d, %d values x %d passes\n", FILTER_THRESHOLD,
+            FILTER_VALS, FILTER_PASSES);
+    printf("%8s %10s %14s %12s %24s\n", "Variant", "Input", "Sum", "ns/Value",
+            "Branch Misses Per Value");
+    for (int sorted = 1; sorted >= 0; sorted--)
+    {
+        uint64_t state = chase_seed();
+        for (int i = 0; i < FILTER_VALS; i++)
+            vals[i] = (double)(chase_random(&state) % 256);
+        if (sorted)
         {
-            U_vals[i] = A_vals[j];
+            // Counting sort, the values are small integers
+            long counts[256] = {0};
+            for (int i = 0; i < FILTER_VALS; i++)
+                counts[(int)vals[i]]++;
+            int k = 0;
+            for (int value = 0; value < 256; value++)
+                for (long c = 0; c < counts[value]; c++)
+                    vals[k++] = value;
         }
-        for (int j = i+1; j < n_vals; j++)
+
+        for (int v = 0; v < n_variants; v++)
         {
-            L_vals[i] = A_vals[j];
+            if (variants[v].filter == NULL || !simd_supported(variants[v].name))
+                continue;
+            double sum = 0;
+            counters_start(&counters);
+            start = get_time();
+            for (int pass = 0; pass < FILTER_PASSES; pass++)
+                sum += variants[v].filter(vals, FILTER_VALS);
+            end = get_time();
+            counters_stop(&counters);
+
+            long long misses = get_counter(&counters, COUNTER_BRANCH_MISSES);
+            printf("%8s %10s %14.6e %12.4f", variants[v].name, sorted ? "sorted" : "shuffled",
+                    sum, (end - start) / n_filtered * 1e9);
+            if (misses >= 0)
+                printf(" %24.4f\n", (double)misses / n_filtered);
+            else
+                printf(" %24s\n", "n/a");
         }
     }
-    end = get_time();
-    sum_L = norm(L_vals, n_vals);
-    sum_U = norm(U_vals, n_vals);
-    printf("Norm L %e, Norm U %e\n", sum_L, sum_U);  // error checking
-    printf("Elapsed restructured %e\n", end - start);
-    
-
-    return 0;   
+
+    counters_close(&counters);
+    free(vals);
+    free(A_vals);
+    free(L_vals);
+    free(U_vals);
+
+    return 0;
 }
@@ -9,32 +9,50 @@
 // Import timer.h (the other file I have uploaded) 
 // as it has all of the timing methods
 #include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+#include "../allocator.h"
 
-
-// This is the main program
-int main(int argc, char* argv[])
+// Everything the timed loop needs, so the benchmark harness can call it repeatedly
+typedef struct
 {
-    // This program requires input (the size of the array we are reading)
-    if (argc == 1)
+    double* vals;
+    int* pos;
+    int size;
+} random_access_args;
+
+// Stepping through the arrays pos and vals.  We are stepping through the vals array 
+// in a random order, so if the array is large enough most accesses will be from main memory.
+// Must be random because of 'cache lines' which we will learn about for 08/21/20.
+void random_access(void* data, long n_outer)
+{
+    random_access_args* args = (random_access_args*)data;
+    int ptr;
+    for (long i = 0; i < n_outer; i++)
     {
-        printf("Need input arg\n");
-        return 0;
+        for (int j = 0; j < args->size; j++)
+        {
+            ptr = args->pos[j];
+            args->vals[ptr] *= 2;
+        }
     }
+}
 
-    // This seeds the random number generator, 
-    // so it is different every time you run the program
-    srand(time(NULL));
 
+// Time random accesses to an array of 'size' doubles, allocated with backend
+void time_random_access(int size, int backend)
+{
     // Initialize the variables
-    int n_access = 100000000;
-    int size = atoi(argv[1]);
-    int n_outer = n_access / size;
-    int ptr, tmp;
+    int tmp;
     double scale = 1.0 * RAND_MAX/size;
 
     // Create a double array of size 'size' (program input)
     // This is the array we are accessing from memory
-    double* vals = (double*)malloc(size*sizeof(double));
+    // (the allocation backend decides the page size, and so the TLB reach)
+    alloc_buffer vals_buf;
+    if (allocate_buffer(&vals_buf, size*sizeof(double), backend) != 0)
+        return;
+    double* vals = (double*)vals_buf.ptr;
 
     // Random order to step through list
     // Create an 'integer' array which will hold the position in 'vals'
@@ -58,24 +76,21 @@ int main(int argc, char* argv[])
         vals[i] = 1.0;
     }
 
-    // Start timer
-    double start = get_time();
-
-    // Stepping through the arrays pos and vals.  We are stepping through the vals array 
-    // in a random order, so if the array is large enough most accesses will be from main memory.
-    // Must be random because of 'cache lines' which we will learn about for 08/21/20.
-    for (int i = 0; i < n_outer; i++)
-    {
-        for (int j = 0; j < size; j++)
-        {
-            ptr = pos[j];
-            vals[ptr] *= 2;
-        }
-    }
-    double end = get_time();
-
-    // Get measurements, such as seconds from timeofday, as well as rate at which data is accessed
-    double seconds = get_seconds(start, end);
+    // Time the random accesses many times
+    // The number of passes over the array is calibrated so each timing takes
+    // about the same wall-clock time, no matter how large 'size' is
+    random_access_args args;
+    args.vals = vals;
+    args.pos = pos;
+    args.size = size;
+    benchmark_config config = default_benchmark_config();
+    benchmark_stats stats;
+    long n_outer = run_benchmark_calibrated(random_access, NULL, &args, config, &stats);
+
+    // Get measurements, using the median run so a single noisy run doesn't skew the result
+    // Stats are per pass over the array, so each pass accesses 'size' values
+    double seconds = stats.median;
+    long n_access = size;
 
     // For data access rate, including double and int because vals and pos,
     // but this may not be 100% accurate as pos is not out of order and much
@@ -86,10 +101,50 @@ int main(int argc, char* argv[])
     double grate = get_grate(rate);
 
     // Print out the information about the run to the screen
-    printf("Size %d, Seconds %e, Seconds Per Double %e, Gbytes/sec %e\n", size, seconds, seconds / n_access, grate);
+    printf("Size %d, Alloc %s, Passes %ld, Seconds Per Pass %e, Seconds Per Double %e, Gbytes/sec %e\n",
+            size, alloc_backend_name(vals_buf.backend), n_outer, seconds, seconds / n_access, grate);
+    print_stats("Seconds Per Pass", &stats);
 
-    free(vals);
+    free_buffer(&vals_buf);
     free(pos);
+}
+
+
+// This is the main program
+// Pass the size of the array we are reading, or no input (or 0) to time one
+// size per level of memory (half of each cache, and 4x the last-level cache),
+// using the cache sizes detected on this machine
+// An optional second input picks the allocation backend (see allocator.h),
+// e.g. ./cache_random 0 hugetlb_2m
+int main(int argc, char* argv[])
+{
+    // This seeds the random number generator, 
+    // so it is different every time you run the program
+    srand(time(NULL));
+
+    int size = argc > 1 ? atoi(argv[1]) : 0;
+    int backend = argc > 2 ? parse_alloc_backend(argv[2]) : ALLOC_MALLOC;
+    if (backend < 0)
+        return 1;
+
+    if (size > 0)
+    {
+        time_random_access(size, backend);
+        return 0;
+    }
+
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+    for (int level = 1; level <= topo.n_levels; level++)
+    {
+        if (cache_size(&topo, level) == 0)
+            continue;
+        printf("L%d cache: ", level);
+        time_random_access((cache_size(&topo, level)/2)/sizeof(double), backend);
+    }
+    printf("Main Memory: ");
+    time_random_access((4*last_level_cache_size(&topo))/sizeof(double), backend);
 
     return 0;
 }
@@ -1,11 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "../timer.h"
-
-#define CACHELINE 128
-#define L1 65536 
-#define L2 4194304
-#define L3 8388608
+#include "../benchmark.h"
+#include "../counters.h"
+#include "../topology.h"
+#include "../allocator.h"
 
 void reset_vector(volatile double* vals, int vector_size)
 {
@@ -15,10 +15,10 @@ void reset_vector(volatile double* vals, int vector_size)
     }
 }
 
-double read_vector(volatile double* vals, int vector_size, int n_iter)
+double read_vector(volatile double* vals, int vector_size, long n_iter)
 {
     volatile double sum = 0;
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 0; i < vector_size; i++)
         {
@@ -28,10 +28,10 @@ double read_vector(volatile double* vals, int vector_size, int n_iter)
     return sum;
 }
 
-double read_vector_skip_cacheline(volatile double* vals, int vector_size, int n_iter, int cacheline_dbl)
+double read_vector_skip_cacheline(volatile double* vals, int vector_size, long n_iter, int cacheline_dbl)
 {
     volatile double sum = 0;
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 0; i < cacheline_dbl; i++)
         {
@@ -44,9 +44,9 @@ double read_vector_skip_cacheline(volatile double* vals, int vector_size, int n_
     return sum;
 }
 
-void write_vector(volatile double* vals, int vector_size, int n_iter)
+void write_vector(volatile double* vals, int vector_size, long n_iter)
 {
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 0; i < vector_size; i++)
         {
@@ -55,9 +55,9 @@ void write_vector(volatile double* vals, int vector_size, int n_iter)
     }
 }
 
-void write_vector_skip_cacheline(volatile double* vals, int vector_size, int n_iter, int cacheline_dbl)
+void write_vector_skip_cacheline(volatile double* vals, int vector_size, long n_iter, int cacheline_dbl)
 {
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 0; i < cacheline_dbl; i++)
         {
@@ -79,214 +79,172 @@ double norm(int vector_size, double* vals)
 
 
 
-void print_data(long n_access, double start, double end, double result)
-{
-    double seconds = get_seconds(start, end);
-    long bytes = (n_access*sizeof(double));
-    double rate = get_rate(seconds, bytes);
-    double grate = get_grate(rate);
-    printf("Result %e, Seconds %e, Seconds Per Double %e, Gbytes/sec %e\n", result, seconds, seconds / n_access, grate);
-}
-
-int main(int argc, char* argv[])
+// Everything one timed phase needs, so the benchmark harness can call it repeatedly
+typedef struct
 {
-    int cacheline_dbl = CACHELINE/sizeof(double);
-
-    int read = 1 - atoi(argv[1]);
-
-    long n_access = 805306368;
-    int vector_size = (2*L3)/sizeof(double);
-    int n_iter = n_access / vector_size;
-    double* vals = (double*)malloc(vector_size*sizeof(double));
-    double start, end;
+    double* vals;
+    int vector_size;
+    int cacheline_dbl;
+    int read;
+    int skip;
     double result;
+} cacheline_args;
 
+void cacheline_reset(void* data)
+{
+    cacheline_args* args = (cacheline_args*)data;
+    reset_vector(args->vals, args->vector_size);
+}
 
-    /****************************************
-     **** Main Memory Costs
-     ***************************************/
-    if (read) printf("Reading From Main Memory...\n");
-    else printf("Writing To Main Memory...\n");
-
-    // Time Reading from Main Memory, striding cacheline
-    printf("1. Striding Cacheline:\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-    }
-    else
-    {
-        write_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
-
-    // Time Reading from Main Memory, with cacheline benefit
-    printf("2. Utilizing Cacheline\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector(vals, vector_size, n_iter);
-    }
-    else
-    {
-        write_vector(vals, vector_size, n_iter);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
-    printf("\n\n");
-
-
-
-
-    /****************************************
-     **** L3 Cache Costs
-     ***************************************/
-    if (read) printf("Reading from L3 cache...\n");
-    else printf("Writing to L3 cache...\n");
-    vector_size = (2*L2)/sizeof(double);
-    n_iter = n_access / vector_size;
-
-    // Time Reading from L3 Cache. striding cacheline
-    printf("1. Striding Cacheline:\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-    }
-    else
-    {
-        write_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
-
-    // Time Reading from L3 Cache, with cacheline benefit
-    printf("2. Utilizing Cacheline\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector(vals, vector_size, n_iter);
-    }
-    else
-    {
-        write_vector(vals, vector_size, n_iter);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
-    printf("\n\n");
-
-
-
-
-
-    /****************************************
-     **** L2 Cache Costs
-     ***************************************/
-    if (read) printf("Reading from L2 cache...\n");
-    else printf("Writing to L2 cache...\n");
-    vector_size = (2*L1) / sizeof(double);
-    n_iter = n_access / vector_size;
-
-    // Time Reading from L2 Cache, striding cacheline
-    printf("1. Striding Cacheline:\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-    }
-    else
-    {
-        write_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
-
-    // Time Reading from L3 Cache, with cacheline benefit
-    printf("2. Utilizing Cacheline\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector(vals, vector_size, n_iter);
-    }
+void cacheline_kernel(void* data, long n_iter)
+{
+    cacheline_args* args = (cacheline_args*)data;
+    if (args->read && args->skip)
+        args->result = read_vector_skip_cacheline(args->vals, args->vector_size,
+                n_iter, args->cacheline_dbl);
+    else if (args->read)
+        args->result = read_vector(args->vals, args->vector_size, n_iter);
+    else if (args->skip)
+        write_vector_skip_cacheline(args->vals, args->vector_size, n_iter,
+                args->cacheline_dbl);
     else
-    {
-        write_vector(vals, vector_size, n_iter);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
-    printf("\n\n");
-
-
-
-
-    /****************************************
-     **** L1 Cache Costs
-     ***************************************/
-    if (read) printf("Reading from L1 cache...\n");
-    else printf("Writing to L1 cache...\n");
-    vector_size = (L1/2) / sizeof(double);
-    n_iter = n_access / vector_size;
+        write_vector(args->vals, args->vector_size, n_iter);
+}
 
+// Prints the median run (and the spread over all runs)
+// Stats hold seconds per pass over the vector, and each pass accesses n_access doubles
+void print_data(long n_access, long n_iter, benchmark_stats* stats, double result)
+{
+    double seconds = stats->median;
+    long bytes = (n_access*sizeof(double));
+    double rate = get_rate(seconds, bytes);
+    double grate = get_grate(rate);
+    printf("Result %e, Passes %ld, Seconds Per Pass %e, Seconds Per Double %e, Gbytes/sec %e\n",
+            result, n_iter, seconds, seconds / n_access, grate);
+    print_stats("   Seconds Per Pass", stats);
+}
 
-    // Time Reading from L1 Cache, striding cacheline
-    printf("1. Striding Cacheline:\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
-    {
-        result = read_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-    }
-    else
-    {
-        write_vector_skip_cacheline(vals, vector_size, n_iter, cacheline_dbl);
-        result = norm(vector_size, vals);
-    }
-    end = get_time();
-    print_data(n_access, start, end, result);
+// Time one phase (striding the cacheline, or utilizing it) at the current vector size
+// The number of passes is calibrated, so every phase takes about the same time
+// One extra run is measured with hardware counters, to show whether
+// cache misses or TLB misses explain the difference between phases,
+// and with RAPL energy counters (when available)
+void time_phase(cacheline_args* args, perf_counters* counters, energy_probe* energy)
+{
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    benchmark_stats stats;
+    long n_iter = run_benchmark_calibrated(cacheline_kernel, cacheline_reset, args, config, &stats);
+
+    cacheline_reset(args);
+    energy_reset(energy);
+    double start = get_time();
+    energy_start(energy);
+    counters_start(counters);
+    cacheline_kernel(args, n_iter);
+    counters_stop(counters);
+    energy_stop(energy);
+    double seconds = get_seconds(start, get_time());
+
+    if (!args->read)
+        args->result = norm(args->vector_size, args->vals);
+    print_data(args->vector_size, n_iter, &stats, args->result);
+    print_counters(counters, n_iter * args->vector_size);
+    print_energy("   Energy", energy, seconds,
+            1e-9 * n_iter * args->vector_size * sizeof(double), "GB");
+}
 
-    // Time Reading from L1 Cache, with cacheline benefit
-    printf("2. Utilizing Cacheline\n");
-    reset_vector(vals, vector_size);
-    start = get_time();
-    if (read)
+// Usage : ./cacheline <0 (read) or 1 (write)> [--alloc=backend] [--verify]
+// The allocation backend (see allocator.h, default malloc) sets the page
+// size, and --verify checks the detected cache sizes against a latency sweep
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
     {
-        result = read_vector(vals, vector_size, n_iter);
+        printf("Usage: %s <0 (read) or 1 (write)> [--alloc=backend] [--verify]\n", argv[0]);
+        return 1;
     }
-    else
+    int read = 1 - atoi(argv[1]);
+    int backend = ALLOC_MALLOC;
+    int verify = 0;
+    for (int i = 2; i < argc; i++)
     {
-        write_vector(vals, vector_size, n_iter);
-        result = norm(vector_size, vals);
+        if (strncmp(argv[i], "--alloc=", 8) == 0)
+        {
+            backend = parse_alloc_backend(argv[i] + 8);
+            if (backend < 0)
+                return 1;
+        }
+        else if (strcmp(argv[i], "--verify") == 0)
+            verify = 1;
+        else
+        {
+            printf("Usage: %s <0 (read) or 1 (write)> [--alloc=backend] [--verify]\n", argv[0]);
+            return 1;
+        }
     }
-    end = get_time();
-    print_data(n_access, start, end, result);
-    printf("\n\n");
 
-
-    free(vals);
+    // Line and cache sizes of this machine
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+    if (verify)
+        verify_cache_topology(&topo);
+    int cacheline_dbl = topo.line_size/sizeof(double);
+
+    // Vector sizes for each level of memory (main memory, then each cache
+    // from the last level down, and half of L1)
+    // Each phase times striding the cacheline, then utilizing it
+    char level_names[TOPOLOGY_MAX_LEVEL + 2][32];
+    int level_sizes[TOPOLOGY_MAX_LEVEL + 2];
+    int n_phases = 0;
+    snprintf(level_names[n_phases], 32, "Main Memory");
+    level_sizes[n_phases++] = (2*last_level_cache_size(&topo))/sizeof(double);
+    for (int level = topo.n_levels; level > 1; level--)
+    {
+        if (cache_size(&topo, level) == 0 || cache_size(&topo, level - 1) == 0)
+            continue;
+        snprintf(level_names[n_phases], 32, "L%d cache", level);
+        level_sizes[n_phases++] = (2*cache_size(&topo, level - 1))/sizeof(double);
+    }
+    snprintf(level_names[n_phases], 32, "L1 cache");
+    level_sizes[n_phases++] = (cache_size(&topo, 1)/2)/sizeof(double);
+
+    alloc_buffer vals_buf;
+    if (allocate_buffer(&vals_buf, level_sizes[0]*sizeof(double), backend) != 0)
+        return 1;
+    double* vals = (double*)vals_buf.ptr;
+    printf("Alloc %s\n", alloc_backend_name(vals_buf.backend));
+
+    cacheline_args args;
+    args.vals = vals;
+    args.cacheline_dbl = cacheline_dbl;
+    args.read = read;
+    args.result = 0;
+
+    perf_counters counters;
+    counters_init(&counters);
+    energy_probe energy;
+    energy_init(&energy);
+
+    for (int level = 0; level < n_phases; level++)
+    {
+        if (read) printf("Reading from %s...\n", level_names[level]);
+        else printf("Writing to %s...\n", level_names[level]);
+        args.vector_size = level_sizes[level];
+
+        printf("1. Striding Cacheline:\n");
+        args.skip = 1;
+        time_phase(&args, &counters, &energy);
+
+        printf("2. Utilizing Cacheline\n");
+        args.skip = 0;
+        time_phase(&args, &counters, &energy);
+        printf("\n\n");
+    }
+
+    counters_close(&counters);
+    free_buffer(&vals_buf);
 
     return 0;
 }
-
-
-
-
-
-
-
-
-
-
@@ -0,0 +1,142 @@
+// False sharing between threads
+// Every thread increments its own counter, and the counters are placed a
+// fixed number of bytes apart.  At a distance of 0 every thread updates the
+// same counter (true sharing).  Below the cache line size, the counters are
+// different variables in one line, and every increment has to take the line
+// back from whichever core wrote it last (false sharing).  At one line or
+// more, each thread should run at the single-thread rate, unless the CPU
+// fetches lines in pairs (then 128 bytes are needed).
+// The last row uses padded.h's per_thread_buffer (at least 128 bytes
+// apart, covering adjacent-line prefetch pairs), as per-thread
+// accumulators should.
+//
+// Each distance is timed with plain increments (a load and a store, which
+// can lose updates when shared) and atomic increments (a locked
+// read-modify-write).
+//
+// Compile : gcc -O2 -fopenmp -o false_sharing false_sharing.c -lm
+// Usage   : ./false_sharing [distance_bytes ...]   (default 0 8 64 128 256)
+// e.g.      OMP_NUM_THREADS=8 OMP_PROC_BIND=close ./false_sharing
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+#include "../padded.h"
+
+#define MAX_DISTANCES 32
+#define PADDED_DISTANCE -1
+
+typedef struct
+{
+    char* buf;          // Counter t is at buf + t*distance
+    long distance;
+    int atomic;
+    int n_threads;
+} sharing_args;
+
+// Each thread increments its own counter n_iter times
+// volatile keeps every increment a separate load and store
+void increment(void* data, long n_iter)
+{
+    sharing_args* args = (sharing_args*)data;
+#pragma omp parallel num_threads(args->n_threads)
+    {
+        volatile uint64_t* counter = (volatile uint64_t*)(args->buf
+                + omp_get_thread_num() * args->distance);
+        if (args->atomic)
+            for (long i = 0; i < n_iter; i++)
+                __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+        else
+            for (long i = 0; i < n_iter; i++)
+                *counter += 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long distances[MAX_DISTANCES + 1] = {0, 8, 64, 128, 256};
+    int n_distances = 5;
+    if (argc > 1)
+    {
+        n_distances = 0;
+        for (int i = 1; i < argc && n_distances < MAX_DISTANCES; i++)
+            if (atol(argv[i]) >= 0)
+                distances[n_distances++] = atol(argv[i]);
+    }
+    distances[n_distances++] = PADDED_DISTANCE;
+
+    int n_threads = omp_get_max_threads();
+    long line_size = padded_line_size();
+    printf("Threads %d, Detected Line Size %ld bytes\n", n_threads, line_size);
+
+    per_thread_buffer padded;
+    if (per_thread_alloc(&padded, n_threads, sizeof(uint64_t), line_size) != 0)
+        return 1;
+
+    long max_distance = 8;
+    for (int d = 0; d < n_distances; d++)
+        if (distances[d] > max_distance)
+            max_distance = distances[d];
+    char* buf = NULL;
+    if (posix_memalign((void**)&buf, 4096, n_threads * max_distance + sizeof(uint64_t)) != 0)
+    {
+        printf("Could not allocate counters\n");
+        return 1;
+    }
+
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 20;
+    benchmark_stats stats;
+    double ns[MAX_DISTANCES + 1][2];
+    long bytes_apart[MAX_DISTANCES + 1];
+
+    for (int d = 0; d < n_distances; d++)
+    {
+        sharing_args args;
+        args.n_threads = n_threads;
+        if (distances[d] == PADDED_DISTANCE)
+        {
+            args.buf = padded.data;
+            args.distance = padded.stride;
+        }
+        else
+        {
+            args.buf = buf;
+            args.distance = distances[d];
+        }
+        bytes_apart[d] = args.distance;
+
+        // stats are seconds per increment, on every thread at once
+        for (int atomic = 0; atomic < 2; atomic++)
+        {
+            args.atomic = atomic;
+            run_benchmark_calibrated(increment, NULL, &args, config, &stats);
+            ns[d][atomic] = stats.median * 1e9;
+        }
+    }
+
+    // Slowdown is relative to the padded counters (the last row)
+    printf("%16s %8s %14s %16s %10s\n", "Distance", "Update", "ns/Increment",
+            "Increments/s", "Slowdown");
+    for (int d = 0; d < n_distances; d++)
+    {
+        char label[32];
+        if (distances[d] == PADDED_DISTANCE)
+            snprintf(label, sizeof(label), "per_thread %ld", bytes_apart[d]);
+        else
+            snprintf(label, sizeof(label), "%ld", bytes_apart[d]);
+        for (int atomic = 0; atomic < 2; atomic++)
+            printf("%16s %8s %14.2f %16.3e %9.2fx\n", label, atomic ? "atomic" : "plain",
+                    ns[d][atomic], n_threads * 1e9 / ns[d][atomic],
+                    ns[d][atomic] / ns[n_distances - 1][atomic]);
+    }
+
+    free(buf);
+    per_thread_free(&padded);
+    return 0;
+}
@@ -0,0 +1,200 @@
+// Multi-threaded random updates (GUPS, giga-updates per second)
+// cache_random.c times one thread reading and writing a shuffled list of
+// positions.  Parallel random updates to one large table (as in a hash join
+// or histogram) also depend on how threads avoid losing each other's
+// updates.  Each thread adds 1 to random entries of a shared table of
+// 64-bit counters, in one of three modes:
+//     racy     : plain table[i] += 1, so concurrent updates to one entry can be lost
+//     atomic   : std::atomic fetch_add (a locked read-modify-write on x86)
+//     batched  : each thread generates BATCH_SIZE updates, buckets them by
+//                destination cache line (a counting sort on the line index,
+//                or its high bits for large tables), and then applies them
+//                with fetch_add in table order, so updates to one line are
+//                applied back to back and the addresses move forward
+// After each run, the table is summed to count how many racy updates were lost.
+//
+// Compile : g++ -O3 -fopenmp -o gups gups.cpp
+// Usage   : ./gups [max_bytes] [alloc backend]   (default 1 GiB, malloc)
+// Table sizes grow by 4x from 64 KiB, and thread counts double up to
+// OMP_NUM_THREADS (e.g. OMP_NUM_THREADS=64 OMP_PROC_BIND=spread ./gups)
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <omp.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+#include "../allocator.h"
+
+#define MIN_BYTES (64L << 10)
+#define DEFAULT_MAX_BYTES (1L << 30)
+#define BATCH_BITS 10
+#define BATCH_SIZE (1 << BATCH_BITS)
+
+enum update_mode { RACY, ATOMIC, BATCHED, N_MODES };
+static const char* mode_names[N_MODES] = {"racy", "atomic", "batched"};
+
+// Atomic updates reuse the same table memory
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+        "std::atomic<uint64_t> must have the layout of uint64_t");
+
+typedef struct
+{
+    uint64_t* table;
+    long n;                 // Entries, a power of two
+    int line_shift;         // log2(entries per cache line)
+    int n_threads;
+    int mode;
+    uint64_t seed;          // Advanced every call, so each sample updates new entries
+    std::atomic<long> issued;   // Updates issued over every call
+} gups_args;
+
+// Counting sort of one batch by index >> bucket_shift (at most BATCH_SIZE
+// buckets), which puts the updates in (nearly) table order
+void bucket_by_line(uint64_t* idx, uint64_t* sorted, int bucket_shift)
+{
+    int count[BATCH_SIZE + 1] = {0};
+    for (int i = 0; i < BATCH_SIZE; i++)
+        count[(idx[i] >> bucket_shift) + 1]++;
+    for (int b = 0; b < BATCH_SIZE; b++)
+        count[b + 1] += count[b];
+    for (int i = 0; i < BATCH_SIZE; i++)
+        sorted[count[idx[i] >> bucket_shift]++] = idx[i];
+}
+
+// n_batches batches of BATCH_SIZE updates per thread
+void gups(void* data, long n_batches)
+{
+    gups_args* args = (gups_args*)data;
+    uint64_t mask = args->n - 1;
+    std::atomic<uint64_t>* atomic_table = reinterpret_cast<std::atomic<uint64_t>*>(args->table);
+
+    // One bucket per cache line, or per group of lines once the table has
+    // more than BATCH_SIZE lines
+    int index_bits = 0;
+    while ((1L << index_bits) < args->n) index_bits++;
+    int bucket_shift = args->line_shift;
+    if (index_bits - bucket_shift > BATCH_BITS)
+        bucket_shift = index_bits - BATCH_BITS;
+
+    uint64_t seed = args->seed;
+    args->seed += 0x9E3779B97F4A7C15ULL;
+
+#pragma omp parallel num_threads(args->n_threads)
+    {
+        uint64_t state = seed ^ (0xD1B54A32D192ED03ULL * (omp_get_thread_num() + 1));
+        uint64_t idx[BATCH_SIZE];
+        uint64_t sorted[BATCH_SIZE];
+
+        for (long batch = 0; batch < n_batches; batch++)
+        {
+            for (int i = 0; i < BATCH_SIZE; i++)
+                idx[i] = chase_random(&state) & mask;
+
+            switch (args->mode)
+            {
+                case RACY:
+                    for (int i = 0; i < BATCH_SIZE; i++)
+                        args->table[idx[i]] += 1;
+                    break;
+                case ATOMIC:
+                    for (int i = 0; i < BATCH_SIZE; i++)
+                        atomic_table[idx[i]].fetch_add(1, std::memory_order_relaxed);
+                    break;
+                case BATCHED:
+                    bucket_by_line(idx, sorted, bucket_shift);
+                    for (int i = 0; i < BATCH_SIZE; i++)
+                        atomic_table[sorted[i]].fetch_add(1, std::memory_order_relaxed);
+                    break;
+            }
+        }
+        args->issued += n_batches * BATCH_SIZE;
+    }
+}
+
+// Zero the table with the same threads that update it, so pages are spread
+// over their NUMA nodes
+void clear_table(gups_args* args)
+{
+#pragma omp parallel for schedule(static) num_threads(args->n_threads)
+    for (long i = 0; i < args->n; i++)
+        args->table[i] = 0;
+    args->issued = 0;
+}
+
+long sum_table(gups_args* args)
+{
+    long sum = 0;
+#pragma omp parallel for reduction(+:sum)
+    for (long i = 0; i < args->n; i++)
+        sum += args->table[i];
+    return sum;
+}
+
+int main(int argc, char* argv[])
+{
+    long max_bytes = argc > 1 ? atol(argv[1]) : DEFAULT_MAX_BYTES;
+    int backend = argc > 2 ? parse_alloc_backend(argv[2]) : ALLOC_MALLOC;
+    if (backend < 0)
+        return 1;
+
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+    int max_threads = omp_get_max_threads();
+
+    gups_args args;
+    args.line_shift = 0;
+    while ((sizeof(uint64_t) << args.line_shift) < (size_t)topo.line_size)
+        args.line_shift++;
+    args.seed = chase_seed();
+
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    benchmark_stats stats;
+
+    printf("Max Threads %d, Batch Size %d\n", max_threads, BATCH_SIZE);
+    printf("%12s %8s %8s %10s %12s %14s\n", "Table Bytes", "Threads", "Mode", "GUPS",
+            "ns/Update", "Lost Updates");
+
+    for (long bytes = MIN_BYTES; bytes <= max_bytes; bytes *= 4)
+    {
+        alloc_buffer buf;
+        if (allocate_buffer(&buf, bytes, backend) != 0)
+            return 1;
+        args.table = (uint64_t*)buf.ptr;
+        args.n = bytes / sizeof(uint64_t);
+
+        for (int n_threads = 1; ; n_threads *= 2)
+        {
+            if (n_threads > max_threads)
+                n_threads = max_threads;
+            args.n_threads = n_threads;
+
+            for (int mode = 0; mode < N_MODES; mode++)
+            {
+                args.mode = mode;
+                clear_table(&args);
+                run_benchmark_calibrated(gups, NULL, &args, config, &stats);
+
+                // stats are seconds per batch, on every thread at once
+                double updates_per_second = n_threads * BATCH_SIZE / stats.median;
+                long lost = args.issued - sum_table(&args);
+                printf("%12ld %8d %8s %10.4f %12.2f %13.4f%%\n", bytes, n_threads,
+                        mode_names[mode], updates_per_second * 1e-9,
+                        1e9 / updates_per_second, 100.0 * lost / args.issued);
+                fflush(stdout);
+            }
+
+            if (n_threads == max_threads)
+                break;
+        }
+        free_buffer(&buf);
+    }
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+// Loaded latency : memory latency under background bandwidth pressure
+// pointer_chase.c measures latency on an idle machine.  Once other cores
+// stream through memory, requests queue in the memory controllers and
+// latency rises, slowly at first and then steeply as bandwidth approaches
+// its peak (the curve Intel MLC reports with --loaded_latency).
+//
+// Thread 0 chases pointers through a random cycle much larger than the
+// last-level cache (as in pointer_chase.c), while threads 1..N each run a
+// STREAM-style Triad on their own arrays.  After every chunk of Triad
+// elements, each of those threads spins for a delay, which throttles how fast
+// it injects requests.  Each delay, from no load at all down to no delay, gives
+// one point: the achieved aggregate Triad bandwidth and the chase latency.
+//
+// Compile : gcc -O2 -fopenmp -o loaded_latency loaded_latency.c -lm
+// Usage   : ./loaded_latency [--chase=BYTES] [--triad=BYTES] [--seconds=S]
+//           (chase buffer, bytes per Triad array per thread, and time per point)
+// The number of Triad threads is OMP_NUM_THREADS - 1.  Bind threads so the
+// chase thread keeps its own core, e.g.
+//           OMP_NUM_THREADS=16 OMP_PROC_BIND=close OMP_PLACES=cores ./loaded_latency
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../timer.h"
+#include "../topology.h"
+
+#define CHUNK 512           // Triad elements between delays (12 KiB moved)
+#define CHASE_BATCH 4096    // Loads between checks of the clock
+#define N_DELAYS 13
+#define NO_LOAD -1
+
+// Spin iterations after each chunk, from no load at all to no delay
+static const long delays[N_DELAYS] = {NO_LOAD, 65536, 16384, 8192, 4096, 2048, 1024,
+    512, 256, 128, 64, 16, 0};
+
+typedef struct
+{
+    double* a;
+    double* b;
+    double* c;
+    long n;
+} triad_arrays;
+
+typedef struct
+{
+    char* chase_buf;
+    void** chase_start;
+    triad_arrays* arrays;   // One set per Triad thread
+    int n_triad;            // Triad threads
+    double seconds;         // Time per point
+    long delay;
+    int stop;               // Set by the chase thread when the point is done
+    double* bytes;          // Bytes moved, per Triad thread
+    double latency_ns;
+} loaded_args;
+
+void delay_spin(long n)
+{
+    for (long i = 0; i < n; i++)
+        __asm__ __volatile__("" ::: "memory");
+}
+
+// Triad chunk by chunk, wrapping around the arrays until the chaser is done
+double throttled_triad(triad_arrays* arr, long delay, int* stop)
+{
+    double scalar = 3.0;
+    double bytes = 0;
+    long start = 0;
+    while (!__atomic_load_n(stop, __ATOMIC_RELAXED))
+    {
+        long end = start + CHUNK < arr->n ? start + CHUNK : arr->n;
+        for (long j = start; j < end; j++)
+            arr->a[j] = arr->b[j] + scalar*arr->c[j];
+        bytes += 3.0 * sizeof(double) * (end - start);
+        start = end < arr->n ? end : 0;
+        delay_spin(delay);
+    }
+    return bytes;
+}
+
+// One point : latency with every Triad thread using one delay
+// Returns the achieved Triad bandwidth in GB/s
+double measure_point(loaded_args* args)
+{
+    double elapsed = 0;
+    args->stop = 0;
+    int n_threads = args->delay == NO_LOAD ? 1 : args->n_triad + 1;
+
+#pragma omp parallel num_threads(n_threads)
+    {
+        int t = omp_get_thread_num();
+        if (t == 0)
+        {
+            // Let the Triad threads reach a steady state first
+            void** p = args->chase_start;
+            double start = get_time();
+            while (get_seconds(start, get_time()) < 0.1 * args->seconds)
+                p = chase_pointers(p, CHASE_BATCH);
+
+            long n_loads = 0;
+            start = get_time();
+            while ((elapsed = get_seconds(start, get_time())) < args->seconds)
+            {
+                p = chase_pointers(p, CHASE_BATCH);
+                n_loads += CHASE_BATCH;
+            }
+            __atomic_store_n(&args->stop, 1, __ATOMIC_RELAXED);
+            args->chase_start = p;
+            args->latency_ns = elapsed / n_loads * 1e9;
+        }
+        else
+        {
+            double start = get_time();
+            args->bytes[t - 1] = throttled_triad(&args->arrays[t - 1], args->delay, &args->stop);
+            args->bytes[t - 1] /= get_seconds(start, get_time());
+        }
+    }
+
+    if (args->delay == NO_LOAD)
+        return 0;
+    double rate = 0;
+    for (int t = 0; t < args->n_triad; t++)
+        rate += args->bytes[t];
+    return get_grate(rate);
+}
+
+int main(int argc, char* argv[])
+{
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+
+    int n_triad = omp_get_max_threads() - 1;
+    if (n_triad < 1)
+    {
+        printf("Needs at least 2 threads (OMP_NUM_THREADS), one to chase and one to load memory\n");
+        return 1;
+    }
+
+    long llc = last_level_cache_size(&topo);
+    long chase_bytes = 4 * llc < (1L << 30) ? 4 * llc : (1L << 30);
+    long triad_bytes = 2 * llc / n_triad;
+    if (triad_bytes < (8L << 20)) triad_bytes = 8L << 20;
+    double seconds = 0.5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--chase=", 8) == 0)
+            chase_bytes = atol(argv[i] + 8);
+        else if (strncmp(argv[i], "--triad=", 8) == 0)
+            triad_bytes = atol(argv[i] + 8);
+        else if (strncmp(argv[i], "--seconds=", 10) == 0)
+            seconds = atof(argv[i] + 10);
+        else
+        {
+            printf("Usage: %s [--chase=BYTES] [--triad=BYTES] [--seconds=S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    loaded_args args;
+    args.n_triad = n_triad;
+    args.seconds = seconds;
+    args.bytes = (double*)calloc(n_triad, sizeof(double));
+    args.arrays = (triad_arrays*)calloc(n_triad, sizeof(triad_arrays));
+
+    long line_size = topo.line_size;
+    if (posix_memalign((void**)&args.chase_buf, line_size, chase_bytes) != 0)
+    {
+        printf("Could not allocate %ld bytes\n", chase_bytes);
+        return 1;
+    }
+    uint64_t state = chase_seed();
+    build_cycle(args.chase_buf, chase_bytes / line_size, line_size, &state);
+    args.chase_start = (void**)args.chase_buf;
+
+    // Each Triad thread allocates and first-touches its own arrays
+    int failed = 0;
+#pragma omp parallel num_threads(n_triad + 1) reduction(+:failed)
+    {
+        int t = omp_get_thread_num();
+        if (t > 0)
+        {
+            triad_arrays* arr = &args.arrays[t - 1];
+            arr->n = triad_bytes / sizeof(double);
+            arr->a = (double*)malloc(triad_bytes);
+            arr->b = (double*)malloc(triad_bytes);
+            arr->c = (double*)malloc(triad_bytes);
+            if (arr->a == NULL || arr->b == NULL || arr->c == NULL)
+                failed++;
+            else
+                for (long j = 0; j < arr->n; j++)
+                {
+                    arr->a[j] = 1.0;
+                    arr->b[j] = 2.0;
+                    arr->c[j] = 0.0;
+                }
+        }
+    }
+    if (failed)
+    {
+        printf("Could not allocate Triad arrays\n");
+        return 1;
+    }
+
+    printf("Chase %ld bytes, %d Triad Threads x 3 arrays of %ld bytes, %.2f s per point\n",
+            chase_bytes, n_triad, triad_bytes, seconds);
+    printf("%10s %16s %14s\n", "Delay", "Triad GB/s", "Latency ns");
+    for (int d = 0; d < N_DELAYS; d++)
+    {
+        args.delay = delays[d];
+        double gbs = measure_point(&args);
+        if (delays[d] == NO_LOAD)
+            printf("%10s %16.2f %14.2f\n", "idle", gbs, args.latency_ns);
+        else
+            printf("%10ld %16.2f %14.2f\n", delays[d], gbs, args.latency_ns);
+        fflush(stdout);
+    }
+
+    for (int t = 0; t < n_triad; t++)
+    {
+        free(args.arrays[t].a);
+        free(args.arrays[t].b);
+        free(args.arrays[t].c);
+    }
+    free(args.arrays);
+    free(args.bytes);
+    free(args.chase_buf);
+    return 0;
+}
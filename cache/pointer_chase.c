@@ -0,0 +1,92 @@
+// This program measures the latency of each level of memory
+// cache_random.c accesses random positions, but each address is known ahead
+// of time, so the processor overlaps many misses at once (measuring random
+// throughput).  Here, every load depends on the previous one: each cache line
+// holds a pointer to the next line, and the lines form a single random cycle.
+// The time per load is then the true latency of whichever level of memory
+// the working set fits in, and plateaus appear for L1, L2, L3, and DRAM.
+//
+// Usage : ./pointer_chase [max_bytes]   (default 1 GiB, sizes start at 4 KiB)
+// e.g.    gcc -O2 -o pointer_chase pointer_chase.c -lm
+//         ./pointer_chase 4294967296
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+
+#define MIN_BYTES 4096L
+#define DEFAULT_MAX_BYTES (1L << 30)
+
+// Everything the timed loop needs, so the benchmark harness can call it repeatedly
+typedef struct
+{
+    void** start;       // Where each sample starts chasing
+    void** end;         // Where the last sample stopped (keeps the loop from being optimized out)
+} chase_args;
+
+// Each load depends on the result of the previous one
+void chase(void* data, long n_loads)
+{
+    chase_args* args = (chase_args*)data;
+    args->end = chase_pointers(args->start, n_loads);
+    // Continue from here next time, so each sample walks new lines
+    args->start = args->end;
+}
+
+int main(int argc, char* argv[])
+{
+    long max_bytes = DEFAULT_MAX_BYTES;
+    if (argc > 1)
+        max_bytes = atol(argv[1]);
+
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+    long line_size = topo.line_size;
+
+    char* buf = NULL;
+    if (posix_memalign((void**)&buf, line_size, max_bytes) != 0)
+    {
+        printf("Could not allocate %ld bytes\n", max_bytes);
+        return 1;
+    }
+
+    uint64_t state = chase_seed();
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    benchmark_stats stats;
+
+    printf("%12s %12s %14s %12s %12s %8s\n", "Bytes", "Lines", "Loads/Sample",
+            "ns/Load", "Min ns/Load", "CV");
+
+    // Powers of two, and halfway points between them, to resolve each plateau
+    for (long base = MIN_BYTES; base <= max_bytes; base *= 2)
+    {
+        long sizes[2] = {base, base + base / 2};
+        for (int s = 0; s < 2; s++)
+        {
+            long bytes = sizes[s];
+            if (bytes > max_bytes)
+                break;
+            long n_lines = bytes / line_size;
+            build_cycle(buf, n_lines, line_size, &state);
+
+            chase_args args;
+            args.start = (void**)buf;
+            args.end = NULL;
+            long n_loads = run_benchmark_calibrated(chase, NULL, &args, config, &stats);
+
+            printf("%12ld %12ld %14ld %12.2f %12.2f %7.2f%%\n", bytes, n_lines, n_loads,
+                    stats.median * 1e9, stats.min * 1e9, 100.0*stats.cv);
+            fflush(stdout);
+            if (args.end == NULL)
+                printf("Chase ended on NULL\n");
+        }
+    }
+
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,301 @@
+// Software prefetch distance sweep
+// The random-access loop in cache_random.c knows pos[j+d] long before it
+// needs vals[pos[j+d]], but the hardware prefetchers cannot predict a random
+// order, so every miss is exposed.  Issuing __builtin_prefetch d iterations
+// ahead overlaps those misses.  Too short a distance leaves part of the miss
+// latency exposed, and too long a distance evicts prefetched lines (or
+// wastes the fill buffers) before they are used.
+//
+// Two kernels are swept, each with no prefetch and with distances 1, 2, 4, ...:
+//     random  : vals[pos[j]] *= 2 over a shuffled pos (as in cache_random.c),
+//               prefetching vals[pos[j+d]] for writing
+//     strided : sum += vals[j] with a stride of --stride bytes (default one
+//               cache line, as in cacheline.c), prefetching d strides ahead
+// The hardware prefetcher already follows a constant stride, so the strided
+// kernel shows when software prefetch is redundant (or harmful), e.g. at
+// strides past a page, where most hardware prefetchers stop.
+//
+// Working sets are half of each detected cache level and 4x the last-level
+// cache (up to --max bytes).  For each, the best distance and its speedup over
+// no prefetch are reported, as defaults for similar indirect loops.
+//
+// The locality hint is __builtin_prefetch's third argument:
+//     3 : keep in every level (prefetcht0)   2 : L2 and below (prefetcht1)
+//     1 : L3 only (prefetcht2)               0 : non-temporal (prefetchnta)
+//
+// Compile : gcc -O2 -o prefetch prefetch.c -lm
+// Usage   : ./prefetch [--kernel=random|strided|both] [--locality=0-3]
+//                      [--distance=D] [--stride=BYTES] [--max=BYTES] [--alloc=backend]
+// --distance times a single distance instead of sweeping
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+#include "../allocator.h"
+
+#define MAX_DISTANCE 1024
+#define DEFAULT_MAX_BYTES (1L << 30)
+
+typedef struct
+{
+    double* vals;
+    long* pos;          // Random visit order, padded by MAX_DISTANCE entries
+    long size;          // Accesses per pass
+    long stride;        // In doubles (strided kernel)
+    long distance;      // Iterations ahead, 0 for no prefetch
+    double result;
+} prefetch_args;
+
+typedef void (*prefetch_kernel)(void* data, long n_outer);
+
+// __builtin_prefetch needs constant hints, so there is one kernel per locality
+#define PREFETCH_KERNELS(L) \
+void random_prefetch_##L(void* data, long n_outer) \
+{ \
+    prefetch_args* args = (prefetch_args*)data; \
+    double* vals = args->vals; \
+    long* pos = args->pos; \
+    long d = args->distance; \
+    for (long i = 0; i < n_outer; i++) \
+        for (long j = 0; j < args->size; j++) \
+        { \
+            __builtin_prefetch(&vals[pos[j + d]], 1, L); \
+            vals[pos[j]] *= 2; \
+        } \
+} \
+void strided_prefetch_##L(void* data, long n_outer) \
+{ \
+    prefetch_args* args = (prefetch_args*)data; \
+    double* vals = args->vals; \
+    long ahead = args->distance * args->stride; \
+    double sum = 0; \
+    for (long i = 0; i < n_outer; i++) \
+        for (long j = 0; j < args->size * args->stride; j += args->stride) \
+        { \
+            __builtin_prefetch(&vals[j + ahead], 0, L); \
+            sum += vals[j]; \
+        } \
+    args->result += sum; \
+}
+
+PREFETCH_KERNELS(0)
+PREFETCH_KERNELS(1)
+PREFETCH_KERNELS(2)
+PREFETCH_KERNELS(3)
+
+static prefetch_kernel random_kernels[4] = {random_prefetch_0, random_prefetch_1,
+    random_prefetch_2, random_prefetch_3};
+static prefetch_kernel strided_kernels[4] = {strided_prefetch_0, strided_prefetch_1,
+    strided_prefetch_2, strided_prefetch_3};
+
+void random_access(void* data, long n_outer)
+{
+    prefetch_args* args = (prefetch_args*)data;
+    for (long i = 0; i < n_outer; i++)
+        for (long j = 0; j < args->size; j++)
+            args->vals[args->pos[j]] *= 2;
+}
+
+void strided_access(void* data, long n_outer)
+{
+    prefetch_args* args = (prefetch_args*)data;
+    double sum = 0;
+    for (long i = 0; i < n_outer; i++)
+        for (long j = 0; j < args->size * args->stride; j += args->stride)
+            sum += args->vals[j];
+    args->result += sum;
+}
+
+// Median nanoseconds per access
+double time_kernel(prefetch_kernel kernel, prefetch_args* args)
+{
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    benchmark_stats stats;
+    run_benchmark_calibrated(kernel, NULL, args, config, &stats);
+    return stats.median / args->size * 1e9;
+}
+
+typedef struct
+{
+    const char* kernel;
+    long bytes;
+    long best_distance;
+    double base_ns;
+    double best_ns;
+} sweep_result;
+
+// Time no prefetch, then each distance, at one working set
+sweep_result sweep_distances(const char* name, prefetch_kernel base, prefetch_kernel kernel,
+        prefetch_args* args, long bytes, long fixed_distance)
+{
+    sweep_result r;
+    r.kernel = name;
+    r.bytes = bytes;
+    args->distance = 0;
+    r.base_ns = time_kernel(base, args);
+    r.best_ns = r.base_ns;
+    r.best_distance = 0;
+
+    printf("Kernel %s, Working Set %ld bytes, %ld accesses\n", name, bytes, args->size);
+    printf("%12s %12s %10s\n", "Distance", "ns/Access", "Speedup");
+    printf("%12s %12.3f %9.2fx\n", "none", r.base_ns, 1.0);
+    for (long d = fixed_distance ? fixed_distance : 1; d <= MAX_DISTANCE; d *= 2)
+    {
+        args->distance = d;
+        double ns = time_kernel(kernel, args);
+        printf("%12ld %12.3f %9.2fx\n", d, ns, r.base_ns / ns);
+        fflush(stdout);
+        if (ns < r.best_ns)
+        {
+            r.best_ns = ns;
+            r.best_distance = d;
+        }
+        if (fixed_distance)
+            break;
+    }
+    printf("\n");
+    return r;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* kernel = "both";
+    int locality = 3;
+    long fixed_distance = 0;
+    long stride_bytes = 0;
+    long max_bytes = DEFAULT_MAX_BYTES;
+    int backend = ALLOC_MALLOC;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--kernel=", 9) == 0)
+            kernel = argv[i] + 9;
+        else if (strncmp(argv[i], "--locality=", 11) == 0)
+            locality = atoi(argv[i] + 11);
+        else if (strncmp(argv[i], "--distance=", 11) == 0)
+            fixed_distance = atol(argv[i] + 11);
+        else if (strncmp(argv[i], "--stride=", 9) == 0)
+            stride_bytes = atol(argv[i] + 9);
+        else if (strncmp(argv[i], "--max=", 6) == 0)
+            max_bytes = atol(argv[i] + 6);
+        else if (strncmp(argv[i], "--alloc=", 8) == 0)
+        {
+            backend = parse_alloc_backend(argv[i] + 8);
+            if (backend < 0)
+                return 1;
+        }
+        else
+        {
+            printf("Usage: %s [--kernel=random|strided|both] [--locality=0-3] [--distance=D]\n"
+                    "       [--stride=BYTES] [--max=BYTES] [--alloc=backend]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (locality < 0 || locality > 3 || fixed_distance < 0 || fixed_distance > MAX_DISTANCE)
+    {
+        printf("--locality must be 0-3, and --distance 1-%d\n", MAX_DISTANCE);
+        return 1;
+    }
+    int run_random = strcmp(kernel, "random") == 0 || strcmp(kernel, "both") == 0;
+    int run_strided = strcmp(kernel, "strided") == 0 || strcmp(kernel, "both") == 0;
+
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+    if (stride_bytes < (long)sizeof(double))
+        stride_bytes = topo.line_size;
+    long stride = stride_bytes / sizeof(double);
+    printf("Locality %d, Stride %ld bytes\n\n", locality, stride * (long)sizeof(double));
+
+    // Working sets : half of each cache level, and 4x the last level
+    long sizes[TOPOLOGY_MAX_LEVEL + 1];
+    int n_sizes = 0;
+    for (int level = 1; level <= topo.n_levels; level++)
+        if (cache_size(&topo, level) > 0)
+            sizes[n_sizes++] = cache_size(&topo, level) / 2;
+    sizes[n_sizes++] = 4 * last_level_cache_size(&topo);
+
+    sweep_result results[2 * (TOPOLOGY_MAX_LEVEL + 1)];
+    int n_results = 0;
+    uint64_t state = chase_seed();
+
+    for (int s = 0; s < n_sizes; s++)
+    {
+        long bytes = sizes[s] < max_bytes ? sizes[s] : max_bytes;
+        if (s > 0 && bytes <= sizes[s - 1])
+            break;
+
+        prefetch_args args;
+        args.result = 0;
+        args.stride = stride;
+        alloc_buffer buf;
+
+        if (run_random)
+        {
+            // As in cache_random.c, pos is read in order and vals in a shuffled order
+            args.size = bytes / sizeof(double);
+            if (allocate_buffer(&buf, args.size * sizeof(double), backend) != 0)
+                return 1;
+            args.vals = (double*)buf.ptr;
+            args.pos = (long*)malloc((args.size + MAX_DISTANCE + 1) * sizeof(long));
+            for (long i = 0; i < args.size; i++)
+            {
+                args.vals[i] = 1.0;
+                args.pos[i] = i;
+            }
+            for (long i = args.size - 1; i > 0; i--)
+            {
+                long j = chase_random(&state) % (i + 1);
+                long tmp = args.pos[i];
+                args.pos[i] = args.pos[j];
+                args.pos[j] = tmp;
+            }
+            // Prefetches past the end wrap around to the start of the next pass
+            for (long i = 0; i <= MAX_DISTANCE; i++)
+                args.pos[args.size + i] = args.pos[i % args.size];
+
+            results[n_results++] = sweep_distances("random", random_access,
+                    random_kernels[locality], &args, bytes, fixed_distance);
+            free(args.pos);
+            free_buffer(&buf);
+        }
+
+        if (run_strided)
+        {
+            // One access per stride over the working set, with room to prefetch past the end
+            args.size = bytes / stride_bytes;
+            if (args.size == 0)
+                continue;
+            size_t n_vals = (args.size + MAX_DISTANCE + 1) * stride;
+            if (allocate_buffer(&buf, n_vals * sizeof(double), backend) != 0)
+                return 1;
+            args.vals = (double*)buf.ptr;
+            for (size_t i = 0; i < n_vals; i++)
+                args.vals[i] = 1.0;
+
+            results[n_results++] = sweep_distances("strided", strided_access,
+                    strided_kernels[locality], &args, bytes, fixed_distance);
+            free_buffer(&buf);
+        }
+    }
+
+    printf("%8s %14s %14s %16s %10s\n", "Kernel", "Working Set", "Best Distance",
+            "Best ns/Access", "Speedup");
+    for (int i = 0; i < n_results; i++)
+    {
+        char best[32];
+        if (results[i].best_distance == 0)
+            snprintf(best, sizeof(best), "none");
+        else
+            snprintf(best, sizeof(best), "%ld", results[i].best_distance);
+        printf("%8s %14ld %14s %16.3f %9.2fx\n", results[i].kernel, results[i].bytes, best,
+                results[i].best_ns, results[i].base_ns / results[i].best_ns);
+    }
+
+    return 0;
+}
@@ -40,12 +40,29 @@
 /*     program constitutes acceptance of these licensing restrictions.   */
 /*  5. Absolutely no warranty is expressed or implied.                   */
 /*-----------------------------------------------------------------------*/
+#ifdef TUNED
+# define _GNU_SOURCE
+#endif
 # include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
 # include <unistd.h>
 # include <math.h>
 # include <float.h>
 # include <limits.h>
+# include <stdint.h>
 # include <sys/time.h>
+# include "../timer.h"
+#ifdef TUNED
+# include "../topology.h"
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define STREAM_SIMD_X86
+#  include <immintrin.h>
+# elif defined(__aarch64__) && defined(__ARM_NEON)
+#  define STREAM_SIMD_NEON
+#  include <arm_neon.h>
+# endif
+#endif
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -128,6 +145,22 @@
 #   define OFFSET	0
 #endif
 
+/*  The arrays are allocated on the heap, so STREAM_ARRAY_SIZE and OFFSET are
+ *         only defaults, and can be changed at run time:
+ *            ./stream [--offset=N] [--align=BYTES] [--sweep=MIN:MAX] [size ...]
+ *      Each size (in elements) is run in turn, so one invocation can sweep
+ *         from L1-resident arrays up to main memory, e.g.
+ *            ./stream --sweep=1024:8589934592
+ *         runs every power of two from 1024 to 2^33 elements (64 GiB per array).
+ *      a, b, and c are carved from one block aligned to STREAM_ALIGN bytes,
+ *         each OFFSET elements past the end of the previous array, so the
+ *         relative alignment of the arrays (and cache-set aliasing between
+ *         them) is controlled exactly.
+ */
+#ifndef STREAM_ALIGN
+#   define STREAM_ALIGN	4096
+#endif
+
 /*
  *	3) Compile the code with optimization.  Many compilers generate
  *       unreasonably bad code before the optimizer tightens things up.  
@@ -150,10 +183,34 @@
  *     to the compile line.
  *     Note that this changes the minimum array sizes required --- see (1) above.
  *
- *     The preprocessor directive "TUNED" does not do much -- it simply causes the 
- *       code to call separate functions to execute each kernel.  Trivial versions
- *       of these functions are provided, but they are *not* tuned -- they just 
- *       provide predefined interfaces to be replaced with tuned code.
+ *     The preprocessor directive "TUNED" causes the code to call separate
+ *       functions to execute each kernel.  These use hand-vectorized kernels
+ *       (AVX2 or AVX-512 on x86, NEON on AArch64), picked at run time from
+ *       what the CPU supports, or plain scalar loops:
+ *            gcc -O -fopenmp -DTUNED stream.c -o stream_tuned
+ *            ./stream_tuned [--simd=auto|scalar|avx2|avx512|neon] [--nt]
+ *       --nt uses non-temporal (streaming) stores, which bypass the cache.
+ *       A normal store first reads the destination line into the cache
+ *       (write-allocate), so Copy and Scale really move 3 words per element,
+ *       and Add and Triad move 4, while STREAM counts only 2 and 3.  Comparing
+ *       runs with and without --nt shows how much of that traffic streaming
+ *       stores recover.  Only use --nt for arrays much larger than the last
+ *       level cache: streaming stores evict the destination, so cache-resident
+ *       arrays get slower.
+ *       The intrinsic kernels are only built for the default double
+ *       STREAM_TYPE; with -DSTREAM_TYPE=float only the scalar loops are used.
+ *     Each thread runs the tuned kernels on its own contiguous block of the
+ *       arrays (and first-touches the same block), so more threads split the
+ *       work instead of repeating it.
+ *            ./stream_tuned --scaling=compact|scatter|both [size ...]
+ *       runs every thread count from 1 to OMP_NUM_THREADS instead of the
+ *       normal report, with thread t bound to the t-th CPU of the placement:
+ *       compact fills one NUMA node before using the next, scatter deals
+ *       threads out round-robin across nodes.  Each line reports the best
+ *       rate, the rate per thread, and the parallel efficiency (rate over
+ *       threads times the one-thread rate).  The thread count where the
+ *       compact rate stops growing is the saturation point of one socket.
+ *       Scaling runs are not validated; run without --scaling for that.
  *
  *
  *	4) Optional: Mail the results to mccalpin@cs.virginia.edu
@@ -178,24 +235,22 @@
 
 #ifndef STREAM_TYPE
 #define STREAM_TYPE double
+#define STREAM_TYPE_DOUBLE
 #endif
 
-static STREAM_TYPE	a[STREAM_ARRAY_SIZE+OFFSET],
-			b[STREAM_ARRAY_SIZE+OFFSET],
-			c[STREAM_ARRAY_SIZE+OFFSET];
+static STREAM_TYPE	*a, *b, *c;
+static STREAM_TYPE	*stream_block;
+
+static ssize_t	stream_array_size = STREAM_ARRAY_SIZE;
+static ssize_t	stream_offset = OFFSET;
+static size_t	stream_align = STREAM_ALIGN;
 
-static double	avgtime[4] = {0}, maxtime[4] = {0},
-		mintime[4] = {FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX};
+static double	avgtime[4], maxtime[4], mintime[4];
 
 static char	*label[4] = {"Copy:      ", "Scale:     ",
     "Add:       ", "Triad:     "};
 
-static double	bytes[4] = {
-    2 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-    2 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-    3 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE,
-    3 * sizeof(STREAM_TYPE) * STREAM_ARRAY_SIZE
-    };
+static double	bytes[4];
 
 extern double mysecond();
 extern void checkSTREAMresults(int n_iter);
@@ -204,12 +259,18 @@ extern void tuned_STREAM_Copy(int n_iter);
 extern void tuned_STREAM_Scale(STREAM_TYPE scalar, int n_iter);
 extern void tuned_STREAM_Add(int n_iter);
 extern void tuned_STREAM_Triad(STREAM_TYPE scalar, int n_iter);
+extern int select_stream_kernels(const char *name, int nt);
+extern void print_stream_kernels();
+extern void tuned_STREAM_Init();
+extern int run_scaling(const char *placement);
 #endif
 #ifdef _OPENMP
 extern int omp_get_num_threads();
+extern int omp_get_thread_num();
+extern int omp_get_max_threads();
 #endif
 int
-main()
+run_stream()
     {
     int			quantum, checktick();
     int			BytesPerWord;
@@ -219,11 +280,11 @@ main()
     double		t, times[4][NTIMES];
 
     ssize_t stream_accesses = STREAM_ACCESSES;
-    if (STREAM_ARRAY_SIZE > stream_accesses)
-        stream_accesses = STREAM_ARRAY_SIZE;
+    if (stream_array_size > stream_accesses)
+        stream_accesses = stream_array_size;
 
-    int n_iter = stream_accesses / STREAM_ARRAY_SIZE;
-    printf("n_iter %d, array size %d\n", n_iter, STREAM_ARRAY_SIZE);
+    int n_iter = stream_accesses / stream_array_size;
+    printf("n_iter %d, array size %zd\n", n_iter, stream_array_size);
 
     /* --- SETUP --- determine precision and check timing --- */
 
@@ -233,23 +294,28 @@ main()
     BytesPerWord = sizeof(STREAM_TYPE);
     printf("This system uses %d bytes per array element.\n",
 	BytesPerWord);
+#ifdef TUNED
+    print_stream_kernels();
+#endif
 
     printf(HLINE);
 #ifdef N
     printf("*****  WARNING: ******\n");
     printf("      It appears that you set the preprocessor variable N when compiling this code.\n");
-    printf("      This version of the code uses the preprocesor variable STREAM_ARRAY_SIZE to control the array size\n");
+    printf("      This version of the code uses the preprocesor variable STREAM_ARRAY_SIZE to control the default array size\n");
+    printf("      (or pass sizes at run time: ./stream [size ...] or --sweep=MIN:MAX)\n");
     printf("      Reverting to default value of STREAM_ARRAY_SIZE=%llu\n",(unsigned long long) STREAM_ARRAY_SIZE);
     printf("*****  WARNING: ******\n");
 #endif
 
-    printf("Array size = %llu (elements), Offset = %d (elements)\n" , (unsigned long long) STREAM_ARRAY_SIZE, OFFSET);
+    printf("Array size = %llu (elements), Offset = %zd (elements), Alignment = %zu (bytes)\n" ,
+	(unsigned long long) stream_array_size, stream_offset, stream_align);
     printf("Memory per array = %.1f MiB (= %.1f GiB).\n", 
-	BytesPerWord * ( (double) stream_accesses / 1024.0/1024.0),
-	BytesPerWord * ( (double) stream_accesses / 1024.0/1024.0/1024.0));
+	BytesPerWord * ( (double) stream_array_size / 1024.0/1024.0),
+	BytesPerWord * ( (double) stream_array_size / 1024.0/1024.0/1024.0));
     printf("Total memory required = %.1f MiB (= %.1f GiB).\n",
-	(3.0 * BytesPerWord) * ( (double) stream_accesses / 1024.0/1024.),
-	(3.0 * BytesPerWord) * ( (double) stream_accesses / 1024.0/1024./1024.));
+	(3.0 * BytesPerWord) * ( (double) stream_array_size / 1024.0/1024.),
+	(3.0 * BytesPerWord) * ( (double) stream_array_size / 1024.0/1024./1024.));
     printf("Each kernel will be executed %d times.\n", NTIMES);
     printf(" The *best* time for each kernel (excluding the first iteration)\n"); 
     printf(" will be used to compute the reported bandwidth.\n");
@@ -275,12 +341,16 @@ main()
 #endif
 
     /* Get initial value for system clock. */
+#ifdef TUNED
+    tuned_STREAM_Init();
+#else
 #pragma omp parallel for
-    for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+    for (j=0; j<stream_array_size; j++) {
 	    a[j] = 1.0;
 	    b[j] = 2.0;
 	    c[j] = 0.0;
 	}
+#endif
 
     printf(HLINE);
 
@@ -294,9 +364,12 @@ main()
     }
 
     t = mysecond();
-#pragma omp parallel for
+    /* One parallel region for all the repetitions : each thread keeps the
+       same static block of j, so no barrier is needed between them */
+#pragma omp parallel private(iter)
     for (iter = 0; iter < n_iter; iter++)
-        for (j = 0; j < STREAM_ARRAY_SIZE; j++)
+#pragma omp for schedule(static) nowait
+        for (j = 0; j < stream_array_size; j++)
 		    a[j] = 2.0E0 * a[j];
     t = 1.0E6 * (mysecond() - t)/n_iter;
 
@@ -314,53 +387,71 @@ main()
     printf("precision of your system timer.\n");
     printf(HLINE);
     
+    /* Energy is accumulated over all NTIMES runs of each kernel */
+    energy_probe energy[4];
+    energy_init(&energy[0]);
+    for (j=1; j<4; j++)
+        energy[j] = energy[0];
+
     /*	--- MAIN LOOP --- repeat test cases NTIMES times --- */
 
     scalar = 3.0;
     for (k=0; k<NTIMES; k++)
 	{
 	times[0][k] = mysecond();
+	energy_start(&energy[0]);
 #ifdef TUNED
         tuned_STREAM_Copy(n_iter);
 #else
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)        
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
+#pragma omp parallel private(iter)
+    for (iter = 0; iter < n_iter; iter++)
+#pragma omp for schedule(static) nowait
+	    for (j=0; j<stream_array_size; j++)
 	        c[j] = a[j];
 #endif
+	energy_stop(&energy[0]);
 	times[0][k] = (mysecond() - times[0][k]) / n_iter;
 	
 	times[1][k] = mysecond();
+	energy_start(&energy[1]);
 #ifdef TUNED
         tuned_STREAM_Scale(scalar, n_iter);
 #else
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)        
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
+#pragma omp parallel private(iter)
+    for (iter = 0; iter < n_iter; iter++)
+#pragma omp for schedule(static) nowait
+	    for (j=0; j<stream_array_size; j++)
 	        b[j] = scalar*c[j];
 #endif
+	energy_stop(&energy[1]);
 	times[1][k] = (mysecond() - times[1][k]) / n_iter;
 	
 	times[2][k] = mysecond();
+	energy_start(&energy[2]);
 #ifdef TUNED
         tuned_STREAM_Add(n_iter);
 #else
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)        
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
+#pragma omp parallel private(iter)
+    for (iter = 0; iter < n_iter; iter++)
+#pragma omp for schedule(static) nowait
+	    for (j=0; j<stream_array_size; j++)
 	        c[j] = a[j]+b[j];
 #endif
+	energy_stop(&energy[2]);
 	times[2][k] = (mysecond() - times[2][k]) / n_iter;
 	
 	times[3][k] = mysecond();
+	energy_start(&energy[3]);
 #ifdef TUNED
         tuned_STREAM_Triad(scalar, n_iter);
 #else
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)        
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
+#pragma omp parallel private(iter)
+    for (iter = 0; iter < n_iter; iter++)
+#pragma omp for schedule(static) nowait
+	    for (j=0; j<stream_array_size; j++)
 	        a[j] = b[j]+scalar*c[j];
 #endif
+	energy_stop(&energy[3]);
 	times[3][k] = (mysecond() - times[3][k]) / n_iter;
 	}
 
@@ -388,6 +479,14 @@ main()
     }
     printf(HLINE);
 
+    for (j=0; j<4; j++) {
+        double seconds = 0;
+        for (k=0; k<NTIMES; k++)
+            seconds += times[j][k] * n_iter;
+        print_energy(label[j], &energy[j], seconds,
+                1.0E-09 * bytes[j] * n_iter * NTIMES, "GB");
+    }
+
     /* --- Check Results --- */
     checkSTREAMresults(n_iter);
     printf(HLINE);
@@ -395,6 +494,125 @@ main()
     return 0;
 }
 
+/* Carve a, b, and c from one aligned block, stream_offset elements apart,
+   and reset the per-size summary */
+int
+alloc_stream_arrays()
+    {
+    int		j;
+    ssize_t	stride = stream_array_size + stream_offset;
+
+    if (posix_memalign((void**)&stream_block, stream_align,
+		3 * stride * sizeof(STREAM_TYPE)) != 0) {
+	printf("Could not allocate 3 arrays of %zd elements\n", stream_array_size);
+	return -1;
+	}
+    a = stream_block;
+    b = a + stride;
+    c = b + stride;
+
+    bytes[0] = 2 * sizeof(STREAM_TYPE) * stream_array_size;
+    bytes[1] = 2 * sizeof(STREAM_TYPE) * stream_array_size;
+    bytes[2] = 3 * sizeof(STREAM_TYPE) * stream_array_size;
+    bytes[3] = 3 * sizeof(STREAM_TYPE) * stream_array_size;
+    for (j=0; j<4; j++) {
+	avgtime[j] = 0;
+	maxtime[j] = 0;
+	mintime[j] = FLT_MAX;
+	}
+    return 0;
+    }
+
+# define	MAX_SIZES	64
+
+int
+main(int argc, char* argv[])
+    {
+    ssize_t	sizes[MAX_SIZES];
+    int		n_sizes = 0;
+    int		i;
+#ifdef TUNED
+    const char	*simd_name = "auto";
+    const char	*scaling = NULL;
+    int		nt = 0;
+#endif
+
+    for (i = 1; i < argc; i++) {
+#ifdef TUNED
+	if (strncmp(argv[i], "--simd=", 7) == 0) {
+	    simd_name = argv[i] + 7;
+	    continue;
+	    }
+	if (strcmp(argv[i], "--nt") == 0) {
+	    nt = 1;
+	    continue;
+	    }
+	if (strncmp(argv[i], "--scaling=", 10) == 0) {
+	    scaling = argv[i] + 10;
+	    continue;
+	    }
+#endif
+	if (strncmp(argv[i], "--offset=", 9) == 0)
+	    stream_offset = atol(argv[i] + 9);
+	else if (strncmp(argv[i], "--align=", 8) == 0)
+	    stream_align = atol(argv[i] + 8);
+	else if (strncmp(argv[i], "--sweep=", 8) == 0) {
+	    ssize_t size, max_size;
+	    if (sscanf(argv[i] + 8, "%zd:%zd", &size, &max_size) != 2 || size <= 0) {
+		printf("--sweep needs MIN:MAX elements\n");
+		return 1;
+		}
+	    for (; size <= max_size && n_sizes < MAX_SIZES; size *= 2)
+		sizes[n_sizes++] = size;
+	    }
+	else if (argv[i][0] != '-' && n_sizes < MAX_SIZES)
+	    sizes[n_sizes++] = atol(argv[i]);
+	else {
+	    printf("Usage: %s [--offset=N] [--align=BYTES] [--sweep=MIN:MAX] [size ...]\n", argv[0]);
+#ifdef TUNED
+	    printf("       [--simd=auto|scalar|avx2|avx512|neon] [--nt]\n");
+	    printf("       [--scaling=compact|scatter|both]\n");
+#endif
+	    return 1;
+	    }
+	}
+    if (n_sizes == 0)
+	sizes[n_sizes++] = STREAM_ARRAY_SIZE;
+
+    /* posix_memalign needs a power of two, at least the size of a pointer */
+    if (stream_align < sizeof(void*) || (stream_align & (stream_align - 1)) != 0) {
+	printf("--align must be a power of two of at least %zu bytes\n", sizeof(void*));
+	return 1;
+	}
+    if (stream_offset < 0) {
+	printf("--offset must not be negative\n");
+	return 1;
+	}
+#ifdef TUNED
+    if (select_stream_kernels(simd_name, nt) != 0)
+	return 1;
+#endif
+
+    for (i = 0; i < n_sizes; i++) {
+	if (sizes[i] <= 0)
+	    continue;
+	stream_array_size = sizes[i];
+#ifdef TUNED
+	if (scaling != NULL) {
+	    if (run_scaling(scaling) != 0)
+		return 1;
+	    continue;
+	    }
+#endif
+	if (alloc_stream_arrays() != 0)
+	    return 1;
+	run_stream();
+	free(stream_block);
+	}
+
+    return 0;
+    }
+
 # define	M	20
 
 int
@@ -483,7 +701,7 @@ void checkSTREAMresults (int n_iter)
 	aSumErr = 0.0;
 	bSumErr = 0.0;
 	cSumErr = 0.0;
-	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+	for (j=0; j<stream_array_size; j++) {
 		aSumErr += abs(a[j] - aj);
 		bSumErr += abs(b[j] - bj);
 		cSumErr += abs(c[j] - cj);
@@ -510,7 +728,7 @@ void checkSTREAMresults (int n_iter)
 		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
 		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<stream_array_size; j++) {
 			if (abs(a[j]/aj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
@@ -529,7 +747,7 @@ void checkSTREAMresults (int n_iter)
 		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
 		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<stream_array_size; j++) {
 			if (abs(b[j]/bj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
@@ -548,7 +766,7 @@ void checkSTREAMresults (int n_iter)
 		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
 		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<stream_array_size; j++) {
 			if (abs(c[j]/cj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
@@ -572,47 +790,448 @@ void checkSTREAMresults (int n_iter)
 #endif
 }
 
+
 #ifdef TUNED
-/* stubs for "tuned" versions of the kernels */
-void tuned_STREAM_Copy(int n_iter)
+/* "Tuned" versions of the kernels
+ * Every kernel computes dst = f(x, y, scalar) over n elements, in the order
+ *         Copy (c = a), Scale (b = scalar*c), Add (c = a+b), Triad (a = b+scalar*c),
+ *     so one table of function pointers per instruction set covers all four.
+ * The vector kernels peel scalar iterations until dst is aligned to the
+ *     vector width (streaming stores need aligned addresses), use unaligned
+ *     loads for the sources (which --offset can misalign), and finish the
+ *     remainder with scalar iterations.
+ * Streaming stores are weakly ordered, so each kernel ends with a fence
+ *     before its results can be read.
+ */
+typedef void (*stream_kernel)(STREAM_TYPE *dst, const STREAM_TYPE *x,
+	const STREAM_TYPE *y, STREAM_TYPE scalar, ssize_t n, int nt);
+
+typedef struct {
+	const char	*name;
+	int		has_nt;		/* Has non-temporal stores */
+	stream_kernel	kernel[4];
+} stream_kernels;
+
+void scalar_copy(STREAM_TYPE *dst, const STREAM_TYPE *x, const STREAM_TYPE *y,
+	STREAM_TYPE scalar, ssize_t n, int nt)
 {
 	ssize_t j;
-    int iter;
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)    
-        for (j=0; j<STREAM_ARRAY_SIZE; j++)
-            c[j] = a[j];
+	for (j=0; j<n; j++)
+	    dst[j] = x[j];
 }
 
-void tuned_STREAM_Scale(STREAM_TYPE scalar, int n_iter)
+void scalar_scale(STREAM_TYPE *dst, const STREAM_TYPE *x, const STREAM_TYPE *y,
+	STREAM_TYPE scalar, ssize_t n, int nt)
 {
 	ssize_t j;
-    int iter;
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)    
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	        b[j] = scalar*c[j];
+	for (j=0; j<n; j++)
+	    dst[j] = scalar*x[j];
 }
 
-void tuned_STREAM_Add(int n_iter)
+void scalar_add(STREAM_TYPE *dst, const STREAM_TYPE *x, const STREAM_TYPE *y,
+	STREAM_TYPE scalar, ssize_t n, int nt)
 {
 	ssize_t j;
-    int iter;
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)    
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	        c[j] = a[j]+b[j];
+	for (j=0; j<n; j++)
+	    dst[j] = x[j]+y[j];
 }
 
-void tuned_STREAM_Triad(STREAM_TYPE scalar, int n_iter)
+void scalar_triad(STREAM_TYPE *dst, const STREAM_TYPE *x, const STREAM_TYPE *y,
+	STREAM_TYPE scalar, ssize_t n, int nt)
 {
 	ssize_t j;
-    int iter;
-#pragma omp parallel for
-    for (iter = 0; iter < n_iter; iter++)    
-	    for (j=0; j<STREAM_ARRAY_SIZE; j++)
-	        a[j] = b[j]+scalar*c[j];
+	for (j=0; j<n; j++)
+	    dst[j] = x[j]+scalar*y[j];
+}
+
+/* Scalar peel until dst is aligned, vector body, scalar remainder */
+#define SIMD_LOOP(WIDTH, STORE, SCALAR, VECTOR) \
+	for (; j<n && ((uintptr_t)&dst[j] % ((WIDTH)*sizeof(double))) != 0; j++) \
+	    dst[j] = SCALAR; \
+	for (; j+(WIDTH)<=n; j+=(WIDTH)) \
+	    STORE(&dst[j], VECTOR); \
+	for (; j<n; j++) \
+	    dst[j] = SCALAR;
+
+#define SIMD_KERNEL(WIDTH, STORE, STREAM, FENCE, SCALAR, VECTOR) \
+	ssize_t j = 0; \
+	if (nt) { \
+	    SIMD_LOOP(WIDTH, STREAM, SCALAR, VECTOR) \
+	    FENCE; \
+	    } \
+	else { \
+	    SIMD_LOOP(WIDTH, STORE, SCALAR, VECTOR) \
+	    }
+
+#if defined(STREAM_SIMD_X86) && defined(STREAM_TYPE_DOUBLE)
+__attribute__((target("avx2")))
+void avx2_copy(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	SIMD_KERNEL(4, _mm256_store_pd, _mm256_stream_pd, _mm_sfence(),
+	    x[j], _mm256_loadu_pd(&x[j]))
+}
+
+__attribute__((target("avx2")))
+void avx2_scale(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	__m256d s = _mm256_set1_pd(scalar);
+	SIMD_KERNEL(4, _mm256_store_pd, _mm256_stream_pd, _mm_sfence(),
+	    scalar*x[j], _mm256_mul_pd(s, _mm256_loadu_pd(&x[j])))
+}
+
+__attribute__((target("avx2")))
+void avx2_add(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	SIMD_KERNEL(4, _mm256_store_pd, _mm256_stream_pd, _mm_sfence(),
+	    x[j]+y[j], _mm256_add_pd(_mm256_loadu_pd(&x[j]), _mm256_loadu_pd(&y[j])))
+}
+
+__attribute__((target("avx2")))
+void avx2_triad(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	__m256d s = _mm256_set1_pd(scalar);
+	SIMD_KERNEL(4, _mm256_store_pd, _mm256_stream_pd, _mm_sfence(),
+	    x[j]+scalar*y[j],
+	    _mm256_add_pd(_mm256_loadu_pd(&x[j]), _mm256_mul_pd(s, _mm256_loadu_pd(&y[j]))))
+}
+
+__attribute__((target("avx512f")))
+void avx512_copy(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	SIMD_KERNEL(8, _mm512_store_pd, _mm512_stream_pd, _mm_sfence(),
+	    x[j], _mm512_loadu_pd(&x[j]))
+}
+
+__attribute__((target("avx512f")))
+void avx512_scale(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	__m512d s = _mm512_set1_pd(scalar);
+	SIMD_KERNEL(8, _mm512_store_pd, _mm512_stream_pd, _mm_sfence(),
+	    scalar*x[j], _mm512_mul_pd(s, _mm512_loadu_pd(&x[j])))
+}
+
+__attribute__((target("avx512f")))
+void avx512_add(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	SIMD_KERNEL(8, _mm512_store_pd, _mm512_stream_pd, _mm_sfence(),
+	    x[j]+y[j], _mm512_add_pd(_mm512_loadu_pd(&x[j]), _mm512_loadu_pd(&y[j])))
+}
+
+__attribute__((target("avx512f")))
+void avx512_triad(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	__m512d s = _mm512_set1_pd(scalar);
+	SIMD_KERNEL(8, _mm512_store_pd, _mm512_stream_pd, _mm_sfence(),
+	    x[j]+scalar*y[j],
+	    _mm512_add_pd(_mm512_loadu_pd(&x[j]), _mm512_mul_pd(s, _mm512_loadu_pd(&y[j]))))
 }
-/* end of stubs for the "tuned" versions of the kernels */
 #endif
 
+#if defined(STREAM_SIMD_NEON) && defined(STREAM_TYPE_DOUBLE)
+/* NEON has no streaming store intrinsic (only the STNP hint), so
+   these kernels always use regular stores */
+void neon_copy(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	nt = 0;
+	SIMD_KERNEL(2, vst1q_f64, vst1q_f64, (void)0,
+	    x[j], vld1q_f64(&x[j]))
+}
+
+void neon_scale(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	float64x2_t s = vdupq_n_f64(scalar);
+	nt = 0;
+	SIMD_KERNEL(2, vst1q_f64, vst1q_f64, (void)0,
+	    scalar*x[j], vmulq_f64(s, vld1q_f64(&x[j])))
+}
+
+void neon_add(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	nt = 0;
+	SIMD_KERNEL(2, vst1q_f64, vst1q_f64, (void)0,
+	    x[j]+y[j], vaddq_f64(vld1q_f64(&x[j]), vld1q_f64(&y[j])))
+}
+
+void neon_triad(double *dst, const double *x, const double *y, double scalar, ssize_t n, int nt)
+{
+	float64x2_t s = vdupq_n_f64(scalar);
+	nt = 0;
+	SIMD_KERNEL(2, vst1q_f64, vst1q_f64, (void)0,
+	    x[j]+scalar*y[j], vaddq_f64(vld1q_f64(&x[j]), vmulq_f64(s, vld1q_f64(&y[j]))))
+}
+#endif
+
+/* In order of preference, "auto" picks the last one the CPU supports */
+static stream_kernels stream_kernel_table[] = {
+	{"scalar", 0, {scalar_copy, scalar_scale, scalar_add, scalar_triad}},
+#ifdef STREAM_TYPE_DOUBLE
+#ifdef STREAM_SIMD_X86
+	{"avx2", 1, {avx2_copy, avx2_scale, avx2_add, avx2_triad}},
+	{"avx512", 1, {avx512_copy, avx512_scale, avx512_add, avx512_triad}},
+#endif
+#ifdef STREAM_SIMD_NEON
+	{"neon", 0, {neon_copy, neon_scale, neon_add, neon_triad}},
+#endif
+#endif
+};
+
+static stream_kernels	*tuned = &stream_kernel_table[0];
+static int		tuned_nt = 0;
+
+/* CPUID feature check, for kernels built with a target attribute */
+int stream_kernels_supported(const stream_kernels *kernels)
+{
+#ifdef STREAM_SIMD_X86
+	__builtin_cpu_init();
+	if (strcmp(kernels->name, "avx2") == 0)
+	    return __builtin_cpu_supports("avx2");
+	if (strcmp(kernels->name, "avx512") == 0)
+	    return __builtin_cpu_supports("avx512f");
+#endif
+	return 1;
+}
+
+/* Returns 0, or -1 if the named kernels are not built or not supported here */
+int select_stream_kernels(const char *name, int nt)
+{
+	int i, n = sizeof(stream_kernel_table) / sizeof(stream_kernel_table[0]);
+	stream_kernels *found = NULL;
+
+	for (i=0; i<n; i++) {
+	    if (!stream_kernels_supported(&stream_kernel_table[i]))
+		continue;
+	    if (strcmp(name, "auto") == 0 ? (!nt || stream_kernel_table[i].has_nt)
+		    : strcmp(name, stream_kernel_table[i].name) == 0)
+		found = &stream_kernel_table[i];
+	}
+	if (found == NULL) {
+	    printf("No %s kernels for this CPU and STREAM_TYPE, available:", name);
+	    for (i=0; i<n; i++)
+		if (stream_kernels_supported(&stream_kernel_table[i]))
+		    printf(" %s", stream_kernel_table[i].name);
+	    printf("\n");
+	    return -1;
+	}
+	if (nt && !found->has_nt) {
+	    printf("The %s kernels have no non-temporal stores\n", found->name);
+	    return -1;
+	}
+	tuned = found;
+	tuned_nt = nt;
+	return 0;
+}
+
+void print_stream_kernels()
+{
+	printf("Tuned kernels: %s, %s stores\n", tuned->name,
+	    tuned_nt ? "non-temporal" : "regular");
+}
+
+static int	tuned_threads = 0;	/* 0 : the OpenMP default */
+
+int tuned_thread_count()
+{
+#ifdef _OPENMP
+	return tuned_threads > 0 ? tuned_threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/* The block of the arrays the calling thread works on: contiguous, so each
+   thread streams through its own pages, and the same block in every kernel
+   (and in the first touch), so those pages stay local to it */
+void stream_range(ssize_t *lo, ssize_t *hi)
+{
+	ssize_t t = 0, n_threads = 1;
+#ifdef _OPENMP
+	t = omp_get_thread_num();
+	n_threads = omp_get_num_threads();
+#endif
+	*lo = stream_array_size * t / n_threads;
+	*hi = stream_array_size * (t + 1) / n_threads;
+}
+
+void tuned_STREAM_Init()
+{
+#pragma omp parallel num_threads(tuned_thread_count())
+    {
+	ssize_t j, lo, hi;
+	stream_range(&lo, &hi);
+	for (j=lo; j<hi; j++) {
+	    a[j] = 1.0;
+	    b[j] = 2.0;
+	    c[j] = 0.0;
+	    }
+    }
+}
+
+/* Every element only depends on the same element of the other arrays, so
+   threads need no barrier between repetitions */
+void tuned_STREAM_Run(int k, STREAM_TYPE *dst, const STREAM_TYPE *x,
+	const STREAM_TYPE *y, STREAM_TYPE scalar, int n_iter)
+{
+#pragma omp parallel num_threads(tuned_thread_count())
+    {
+	ssize_t lo, hi;
+	int iter;
+	stream_range(&lo, &hi);
+	for (iter = 0; iter < n_iter; iter++)
+	    tuned->kernel[k](dst+lo, x+lo, y ? y+lo : NULL, scalar, hi-lo, tuned_nt);
+    }
+}
+
+void tuned_STREAM_Copy(int n_iter)
+{
+	tuned_STREAM_Run(0, c, a, NULL, 0, n_iter);
+}
+
+void tuned_STREAM_Scale(STREAM_TYPE scalar, int n_iter)
+{
+	tuned_STREAM_Run(1, b, c, NULL, scalar, n_iter);
+}
+
+void tuned_STREAM_Add(int n_iter)
+{
+	tuned_STREAM_Run(2, c, a, b, 0, n_iter);
+}
+
+void tuned_STREAM_Triad(STREAM_TYPE scalar, int n_iter)
+{
+	tuned_STREAM_Run(3, a, b, c, scalar, n_iter);
+}
+
+/* --- SCALING --- */
+
+/* CPUs in placement order: compact takes every CPU of a node before moving
+   to the next node, scatter takes one CPU from each node in turn.
+   Returns the number of CPUs. */
+int placement_cpus(numa_topology *numa, int scatter, int *cpus)
+{
+	int n = 0, node, cpu, round, seen, taken;
+
+	if (!scatter) {
+	    for (node = 0; node < numa->n_nodes; node++)
+		for (cpu = 0; cpu < numa->n_cpus; cpu++)
+		    if (numa->node_of_cpu[cpu] == node)
+			cpus[n++] = cpu;
+	    return n;
+	    }
+	for (round = 0; ; round++) {
+	    taken = 0;
+	    for (node = 0; node < numa->n_nodes; node++) {
+		seen = 0;
+		for (cpu = 0; cpu < numa->n_cpus; cpu++)
+		    if (numa->node_of_cpu[cpu] == node && seen++ == round) {
+			cpus[n++] = cpu;
+			taken = 1;
+			break;
+			}
+		}
+	    if (!taken)
+		return n;
+	    }
+}
+
+void bind_tuned_thread(int *cpus)
+{
+	int t = 0;
+#ifdef _OPENMP
+	t = omp_get_thread_num();
+#endif
+	bind_thread_to_cpu(cpus[t]);
+}
+
+/* Best rate (MB/s) of each kernel over NTIMES, skipping the first */
+void scaling_rates(int n_iter, double rates[4])
+{
+	STREAM_TYPE	scalar = 3.0;
+	double		t;
+	int		j, k;
+
+	for (j=0; j<4; j++)
+	    mintime[j] = FLT_MAX;
+	for (k=0; k<NTIMES; k++)
+	    for (j=0; j<4; j++) {
+		t = mysecond();
+		switch (j) {
+		    case 0: tuned_STREAM_Copy(n_iter); break;
+		    case 1: tuned_STREAM_Scale(scalar, n_iter); break;
+		    case 2: tuned_STREAM_Add(n_iter); break;
+		    case 3: tuned_STREAM_Triad(scalar, n_iter); break;
+		    }
+		t = (mysecond() - t) / n_iter;
+		if (k > 0)
+		    mintime[j] = MIN(mintime[j], t);
+		}
+	for (j=0; j<4; j++)
+	    rates[j] = 1.0E-06 * bytes[j] / mintime[j];
+}
+
+/* Sweep 1..OMP_NUM_THREADS threads with compact and/or scatter placement.
+   The arrays are reallocated for every thread count, so the first touch
+   puts each thread's block on its own node. */
+int run_scaling(const char *placement)
+{
+	static const char	*names[2] = {"compact", "scatter"};
+	numa_topology	numa;
+	int		cpus[TOPOLOGY_MAX_CPUS];
+	int		p, t, j, n_cpus, n_threads, max_threads = 1;
+	double		rates[4], one_thread[4];
+	ssize_t		stream_accesses = MAX(STREAM_ACCESSES, stream_array_size);
+	int		n_iter = stream_accesses / stream_array_size;
+
+	if (strcmp(placement, "compact") != 0 && strcmp(placement, "scatter") != 0
+		&& strcmp(placement, "both") != 0) {
+	    printf("--scaling must be compact, scatter, or both\n");
+	    return -1;
+	    }
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+
+	detect_numa_topology(&numa);
+	printf(HLINE);
+	print_numa_topology(&numa);
+	print_stream_kernels();
+	printf("Array size = %zd (elements), %d repetitions per sample\n",
+	    stream_array_size, n_iter);
+
+	for (p=0; p<2; p++) {
+	    if (strcmp(placement, "both") != 0 && strcmp(placement, names[p]) != 0)
+		continue;
+	    n_cpus = placement_cpus(&numa, p, cpus);
+	    n_threads = MIN(max_threads, n_cpus);
+	    printf(HLINE);
+	    printf("Placement %s, CPUs", names[p]);
+	    for (t=0; t<n_threads; t++)
+		printf(" %d", cpus[t]);
+	    printf("\n");
+	    printf("Threads Function    Best Rate MB/s  MB/s/Thread  Efficiency\n");
+
+	    for (t=1; t<=n_threads; t++) {
+		tuned_threads = t;
+#pragma omp parallel num_threads(t)
+		bind_tuned_thread(cpus);
+		if (alloc_stream_arrays() != 0)
+		    return -1;
+		tuned_STREAM_Init();
+		scaling_rates(n_iter, rates);
+		free(stream_block);
+
+		for (j=0; j<4; j++) {
+		    if (t == 1)
+			one_thread[j] = rates[j];
+		    printf("%7d %s%12.1f  %11.1f  %9.1f%%\n", t, label[j], rates[j],
+			rates[j] / t, 100.0 * rates[j] / (t * one_thread[j]));
+		    }
+		fflush(stdout);
+		}
+
+#pragma omp parallel num_threads(max_threads)
+	    unbind_thread(&numa);
+	    }
+	tuned_threads = 0;
+	return 0;
+}
+#endif
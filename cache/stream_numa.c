@@ -0,0 +1,195 @@
+// NUMA-aware STREAM Triad
+// On a multi-socket node, a page lives on the NUMA node of the thread that
+// first touches it.  stream.c's arrays can easily end up on one node,
+// capping "OpenMP" bandwidth at a single socket's memory controllers.  This
+// program shows
+//     1. Where each OpenMP thread is running (thread -> CPU -> node)
+//     2. Triad bandwidth with serial vs parallel first-touch initialization
+//        (parallel first touch uses the kernel's own static schedule, so each
+//        thread's part of the arrays is local to it)
+//     3. A node x node bandwidth matrix: threads bound to node i, with memory
+//        bound (mbind) to node j, to size jobs per socket
+//
+// Compile : gcc -O3 -fopenmp -o stream_numa stream_numa.c -lm
+// Usage   : ./stream_numa [array_size]   (doubles per array, default 2^25)
+// Binding threads with OMP_PROC_BIND=true (or spread/close) also keeps the
+// first-touch comparison stable.
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <omp.h>
+#include <sys/mman.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+
+#define DEFAULT_ARRAY_SIZE (1L << 25)
+#define PAGE_SIZE 4096
+
+typedef struct
+{
+    double* a;
+    double* b;
+    double* c;
+    long n;
+    size_t bytes;       // Mapped bytes per array
+    int n_threads;
+} triad_args;
+
+// Same static schedule as the parallel first touch
+void triad(void* data)
+{
+    triad_args* args = (triad_args*)data;
+    double scalar = 3.0;
+#pragma omp parallel for schedule(static) num_threads(args->n_threads)
+    for (long j = 0; j < args->n; j++)
+        args->a[j] = args->b[j] + scalar*args->c[j];
+}
+
+void init_serial(triad_args* args)
+{
+    for (long j = 0; j < args->n; j++)
+    {
+        args->a[j] = 1.0;
+        args->b[j] = 2.0;
+        args->c[j] = 0.0;
+    }
+}
+
+void init_parallel(triad_args* args)
+{
+#pragma omp parallel for schedule(static) num_threads(args->n_threads)
+    for (long j = 0; j < args->n; j++)
+    {
+        args->a[j] = 1.0;
+        args->b[j] = 2.0;
+        args->c[j] = 0.0;
+    }
+}
+
+void free_arrays(triad_args* args)
+{
+    double* arrays[3] = {args->a, args->b, args->c};
+    for (int i = 0; i < 3; i++)
+        if (arrays[i] != NULL)
+            munmap(arrays[i], args->bytes);
+}
+
+// Arrays mapped fresh from the kernel (and unmapped by free_arrays), bound to
+// mem_node if it is not -1.  malloc could hand back pages an earlier run
+// already faulted in (on its node), but new mappings have no pages yet, so
+// placement is decided by the first touch (or mbind).
+int alloc_arrays(triad_args* args, int mem_node)
+{
+    args->bytes = (args->n*sizeof(double) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    double** arrays[3] = {&args->a, &args->b, &args->c};
+    for (int i = 0; i < 3; i++)
+        *arrays[i] = NULL;
+    for (int i = 0; i < 3; i++)
+    {
+        void* ptr = mmap(NULL, args->bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED)
+            *arrays[i] = (double*)ptr;
+        if (*arrays[i] == NULL
+                || (mem_node >= 0 && bind_memory_to_node(*arrays[i], args->bytes, mem_node) != 0))
+        {
+            free_arrays(args);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Best Triad bandwidth (GB/s) over the repeat harness
+double triad_bandwidth(triad_args* args)
+{
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 20;
+    benchmark_stats stats;
+    run_benchmark(triad, NULL, args, config, &stats);
+    return get_grate(get_rate(stats.min, 3 * sizeof(double) * args->n));
+}
+
+// Report which CPU and node each thread runs on
+void print_binding(numa_topology* numa, int n_threads)
+{
+    const char* bind_names[5] = {"false", "true", "master", "close", "spread"};
+    int bind = omp_get_proc_bind();
+    printf("OMP_PROC_BIND %s, %d Threads\n", bind >= 0 && bind < 5 ? bind_names[bind] : "unknown",
+            n_threads);
+    int* cpus = (int*)malloc(n_threads*sizeof(int));
+#pragma omp parallel num_threads(n_threads)
+    cpus[omp_get_thread_num()] = current_cpu();
+    for (int t = 0; t < n_threads; t++)
+        printf("   Thread %d: CPU %d, Node %d\n", t, cpus[t], numa_node_of(numa, cpus[t]));
+    free(cpus);
+}
+
+int main(int argc, char* argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : DEFAULT_ARRAY_SIZE;
+
+    numa_topology numa;
+    detect_numa_topology(&numa);
+    print_numa_topology(&numa);
+
+    triad_args args;
+    args.n = n;
+    args.n_threads = omp_get_max_threads();
+    printf("Array Size %ld (%.1f MiB per array)\n", n, n*sizeof(double) / 1048576.0);
+    print_binding(&numa, args.n_threads);
+
+    // First touch : serial puts every page on the master thread's node
+    if (alloc_arrays(&args, -1) != 0)
+        return 1;
+    init_serial(&args);
+    printf("Serial First Touch:   Triad %.2f GB/s\n", triad_bandwidth(&args));
+    free_arrays(&args);
+
+    if (alloc_arrays(&args, -1) != 0)
+        return 1;
+    init_parallel(&args);
+    printf("Parallel First Touch: Triad %.2f GB/s\n", triad_bandwidth(&args));
+    free_arrays(&args);
+
+    // Node x node matrix : threads (one per CPU) bound to node i, memory on node j
+    printf("\nTriad GB/s, CPU Node (rows) x Memory Node (columns)\n%10s", "");
+    for (int j = 0; j < numa.n_nodes; j++)
+        if (numa.online[j])
+            printf("  Mem %4d", j);
+    printf("\n");
+    for (int i = 0; i < numa.n_nodes; i++)
+    {
+        if (numa.cpus_per_node[i] == 0)
+            continue;
+        printf("CPU %4d  ", i);
+        args.n_threads = numa.cpus_per_node[i];
+#pragma omp parallel num_threads(args.n_threads)
+        bind_thread_to_node(&numa, i);
+
+        // Memory-only nodes (e.g. CXL or HBM) have no CPUs, but are still measured
+        for (int j = 0; j < numa.n_nodes; j++)
+        {
+            if (!numa.online[j])
+                continue;
+            if (alloc_arrays(&args, j) != 0)
+            {
+                printf("%10s", "n/a");
+                continue;
+            }
+            init_parallel(&args);
+            printf("%10.2f", triad_bandwidth(&args));
+            fflush(stdout);
+            free_arrays(&args);
+        }
+        printf("\n");
+
+#pragma omp parallel num_threads(args.n_threads)
+        unbind_thread(&numa);
+    }
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+// Stride x working-set heatmap
+// cacheline.c compares unit stride with a one-line stride at one working set
+// per cache level.  This sweeps both at once: every working set from 4 KiB
+// to 1 GiB (powers of two), and every stride from one 8-byte element to
+// 4 KiB, plus strides that cross a page on every access.  Each repetition
+// touches every element of the working set once, as passes over the set at
+// the stride, each pass starting from a different element of the first
+// stride, so every cell moves the same bytes and only the order differs.
+//
+// At strides of a line or more, the passes go offset-major : first offset 0
+// of every line in the stride (so every line of the working set once), then
+// offset 1, and so on.  A line is revisited only after the rest of the
+// working set, so each access pays for a line fetch at that stride.  (Taking
+// the passes in element order instead revisits the same n/stride lines in
+// stride/8 consecutive passes, which fit in cache at large strides, and
+// measure cache hits.)
+//
+// The matrices show
+//     rows (working set)  : the capacity of each cache level and the TLB reach
+//     columns (stride)    : the end of spatial locality (one line), the
+//                           hardware prefetcher giving up (usually a page),
+//                           and cache-set aliasing at large power-of-two
+//                           strides (compare 4096 with 4160)
+//
+// Reads sum the elements, and writes store to them.  Each is written as two
+// CSV matrices (GB/s and ns per access), rows by working set and columns by
+// stride, to <prefix>_read_gbs.csv, <prefix>_read_ns.csv, <prefix>_write_gbs.csv
+// and <prefix>_write_ns.csv.  Cells where the stride is larger than the
+// working set are left empty.
+//
+// Compile : gcc -O2 -o stride_heatmap stride_heatmap.c -lm
+// Usage   : ./stride_heatmap [--min=BYTES] [--max=BYTES] [--csv=prefix] [--alloc=backend]
+//           (defaults 4096, 1073741824, stride_heatmap, malloc)
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../topology.h"
+#include "../allocator.h"
+
+#define MAX_SIZES 40
+#define N_STRIDES 16
+
+// Bytes : powers of two up to a page, then strides that cross pages
+// (4160 is one page plus a line, which avoids mapping every access to
+// the same cache set)
+static const long strides[N_STRIDES] = {8, 16, 32, 64, 128, 256, 512, 1024, 2048,
+    4096, 4160, 8192, 16384, 65536, 262144, 2097152};
+
+typedef struct
+{
+    uint64_t* vals;
+    long n;             // Elements in the working set
+    long stride;        // In elements
+    long line_elems;    // Elements per cache line
+    int write;
+    uint64_t result;
+} stride_args;
+
+// Integer adds, so reads are not limited by floating point add latency
+void stride_kernel(void* data, long n_iter)
+{
+    stride_args* args = (stride_args*)data;
+    uint64_t* vals = args->vals;
+    long n = args->n;
+    long stride = args->stride;
+
+    // Offsets within a line, and lines per stride (one group below a line)
+    long group = stride % args->line_elems == 0 ? args->line_elems : stride;
+    long lines = stride / group;
+    uint64_t sum = 0;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+        for (long offset = 0; offset < group; offset++)
+        {
+            for (long line = 0; line < lines; line++)
+            {
+                long i = line*group + offset;
+                if (args->write)
+                    for (long j = i; j < n; j += stride)
+                        vals[j] = j;
+                else
+                    for (long j = i; j < n; j += stride)
+                        sum += vals[j];
+            }
+        }
+    }
+    args->result += sum;
+}
+
+void write_matrix(const char* filename, long* sizes, int n_sizes, double values[][N_STRIDES])
+{
+    FILE* f = fopen(filename, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return;
+    }
+    fprintf(f, "working_set_bytes");
+    for (int s = 0; s < N_STRIDES; s++)
+        fprintf(f, ",stride_%ld", strides[s]);
+    fprintf(f, "\n");
+    for (int w = 0; w < n_sizes; w++)
+    {
+        fprintf(f, "%ld", sizes[w]);
+        for (int s = 0; s < N_STRIDES; s++)
+        {
+            if (values[w][s] > 0)
+                fprintf(f, ",%.4f", values[w][s]);
+            else
+                fprintf(f, ",");
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+int main(int argc, char* argv[])
+{
+    long min_bytes = 4096;
+    long max_bytes = 1L << 30;
+    const char* prefix = "stride_heatmap";
+    int backend = ALLOC_MALLOC;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--min=", 6) == 0)
+            min_bytes = atol(argv[i] + 6);
+        else if (strncmp(argv[i], "--max=", 6) == 0)
+            max_bytes = atol(argv[i] + 6);
+        else if (strncmp(argv[i], "--csv=", 6) == 0)
+            prefix = argv[i] + 6;
+        else if (strncmp(argv[i], "--alloc=", 8) == 0)
+        {
+            backend = parse_alloc_backend(argv[i] + 8);
+            if (backend < 0)
+                return 1;
+        }
+        else
+        {
+            printf("Usage: %s [--min=BYTES] [--max=BYTES] [--csv=prefix] [--alloc=backend]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (min_bytes < (long)sizeof(uint64_t) || max_bytes < min_bytes)
+    {
+        printf("Need 8 <= --min <= --max\n");
+        return 1;
+    }
+
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+
+    long sizes[MAX_SIZES];
+    int n_sizes = 0;
+    for (long bytes = min_bytes; bytes <= max_bytes && n_sizes < MAX_SIZES; bytes *= 2)
+        sizes[n_sizes++] = bytes;
+
+    alloc_buffer buf;
+    if (allocate_buffer(&buf, sizes[n_sizes - 1], backend) != 0)
+        return 1;
+    printf("Alloc %s\n", alloc_backend_name(buf.backend));
+
+    // Short samples : there are a few hundred cells
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    config.target_seconds = 0.02;
+    benchmark_stats stats;
+
+    static double gbs[2][MAX_SIZES][N_STRIDES];
+    static double ns[2][MAX_SIZES][N_STRIDES];
+    const char* names[2] = {"read", "write"};
+
+    stride_args args;
+    args.vals = (uint64_t*)buf.ptr;
+    args.result = 0;
+    args.line_elems = topo.line_size / sizeof(uint64_t);
+    for (long i = 0; i < sizes[n_sizes - 1] / (long)sizeof(uint64_t); i++)
+        args.vals[i] = i;
+
+    for (int write = 0; write < 2; write++)
+    {
+        args.write = write;
+        printf("\n%s GB/s, Working Set (rows) x Stride Bytes (columns)\n%12s", names[write], "");
+        for (int s = 0; s < N_STRIDES; s++)
+            printf(" %8ld", strides[s]);
+        printf("\n");
+
+        for (int w = 0; w < n_sizes; w++)
+        {
+            args.n = sizes[w] / sizeof(uint64_t);
+            printf("%12ld", sizes[w]);
+            for (int s = 0; s < N_STRIDES; s++)
+            {
+                gbs[write][w][s] = 0;
+                ns[write][w][s] = 0;
+                if (strides[s] > sizes[w])
+                {
+                    printf(" %8s", "");
+                    continue;
+                }
+                args.stride = strides[s] / sizeof(uint64_t);
+                run_benchmark_calibrated(stride_kernel, NULL, &args, config, &stats);
+
+                // stats are seconds per pass, and each pass touches every element once
+                ns[write][w][s] = stats.median / args.n * 1e9;
+                gbs[write][w][s] = get_grate(get_rate(stats.median, sizes[w]));
+                printf(" %8.2f", gbs[write][w][s]);
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s_%s_gbs.csv", prefix, names[write]);
+        write_matrix(filename, sizes, n_sizes, gbs[write]);
+        snprintf(filename, sizeof(filename), "%s_%s_ns.csv", prefix, names[write]);
+        write_matrix(filename, sizes, n_sizes, ns[write]);
+    }
+
+    if (args.result == 0)
+        printf("Sum %lu\n", (unsigned long)args.result);
+    free_buffer(&buf);
+    return 0;
+}
@@ -0,0 +1,315 @@
+// TLB reach and page-walk cost
+// pointer_chase.c grows the working set line by line, so TLB misses and
+// cache misses start at the same time.  Here, the chase touches a single
+// line in each page, so a growing number of pages needs very little cache
+// (one line per page, at a different offset in each page to spread the lines
+// over the cache sets), while every page needs its own TLB entry.  As the page
+// count passes the L1 dTLB, then the second-level TLB, then what the
+// page-walk caches cover, each load pays a longer translation, and
+// cycles per load step up.
+//
+// The sweep runs with 4 KiB pages (madvise(MADV_NOHUGEPAGE), so transparent
+// huge pages do not hide the misses), 2 MiB pages and 1 GiB pages (hugetlb,
+// see allocator.h; reserve them first).  Huge pages cover far more memory per
+// entry, so their sweeps use every free reserved page (up to 8 GiB), e.g.
+//     echo 4096 > /sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages
+//
+// Cycles come from the hardware cycle counter (counters.h) when available,
+// and otherwise from nanoseconds times a clock rate estimated with a
+// dependent multiply chain.  Each step of more than STEP_RATIO in cycles per
+// load is reported as a TLB level with (about) that many entries, unless it
+// is a cache step : with the dTLB miss counter, TLB steps are the ones where
+// misses per load also rise by MISS_STEP; without it, steps where the
+// touched lines (one per page) outgrow a cache level are reported as cache
+// steps instead.
+//
+// Compile : gcc -O2 -o tlb_reach tlb_reach.c -lm
+// Usage   : ./tlb_reach [--pages=4k,2m,1g] [--max=BYTES]
+//           (default all page sizes, and up to 1 GiB of 4 KiB pages)
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../timer.h"
+#include "../benchmark.h"
+#include "../counters.h"
+#include "../topology.h"
+#include "../allocator.h"
+
+#define MIN_PAGES 4
+#define MAX_POINTS 128
+#define STEP_RATIO 1.25
+#define MISS_STEP 0.1
+#define MUL_LATENCY 3
+#define DEFAULT_MAX_BYTES (1L << 30)
+#define HUGE_MAX_BYTES (8L << 30)
+
+typedef struct
+{
+    const char* name;
+    long page_bytes;
+    int backend;
+} page_size;
+
+typedef struct
+{
+    void** start;
+    void** end;
+} tlb_args;
+
+void tlb_chase(void* data, long n_loads)
+{
+    tlb_args* args = (tlb_args*)data;
+    args->end = chase_pointers(args->start, n_loads);
+    args->start = args->end;
+}
+
+// Clock rate in GHz, from a chain of dependent 64-bit multiplies, each
+// MUL_LATENCY cycles (imul on x86 cores since Sandy Bridge and Zen).
+// Adds of a constant are not used, as recent cores fold them at rename.
+double estimate_ghz()
+{
+    long n = 1L << 24;
+    uint64_t x = 1;
+    uint64_t y = 3;
+    __asm__ __volatile__("" : "+r"(y));     // Not a constant to the compiler
+    double best = 0;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        double start = get_time();
+        for (long i = 0; i < n; i++)
+        {
+            x *= y;
+            __asm__ __volatile__("" : "+r"(x));
+            x *= y;
+            __asm__ __volatile__("" : "+r"(x));
+            x *= y;
+            __asm__ __volatile__("" : "+r"(x));
+            x *= y;
+            __asm__ __volatile__("" : "+r"(x));
+        }
+        double seconds = get_seconds(start, get_time());
+        if (rep == 0 || seconds < best)
+            best = seconds;
+    }
+    if (x == 0)
+        printf("Multiply chain returned 0\n");
+    return 4.0 * MUL_LATENCY * n / best * 1e-9;
+}
+
+// Link one line in each of n_pages pages into a single random cycle
+// (Sattolo's algorithm, as in build_cycle), page k using line k of its page
+void build_page_cycle(char* buf, long n_pages, long page_bytes, long line_size,
+        uint64_t* state)
+{
+    long lines_per_page = page_bytes / line_size;
+    long* order = (long*)malloc(n_pages*sizeof(long));
+    for (long i = 0; i < n_pages; i++)
+        order[i] = i;
+    for (long i = n_pages - 1; i > 0; i--)
+    {
+        long j = chase_random(state) % i;
+        long tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (long i = 0; i < n_pages; i++)
+    {
+        long page = order[i];
+        long next = order[(i + 1) % n_pages];
+        char* from = buf + page*page_bytes + (page % lines_per_page)*line_size;
+        char* to = buf + next*page_bytes + (next % lines_per_page)*line_size;
+        *(void**)from = to;
+    }
+    free(order);
+}
+
+// Free reserved huge pages of page_bytes, or 0 if none (or not Linux)
+long free_huge_pages(long page_bytes)
+{
+    char path[128];
+    char line[64];
+    snprintf(path, sizeof(path), "/sys/kernel/mm/hugepages/hugepages-%ldkB/free_hugepages",
+            page_bytes / 1024);
+    if (topology_read_line(path, line, sizeof(line)) != 0)
+        return 0;
+    return atol(line);
+}
+
+// Sweep page counts for one page size, and report each step in cycles per load
+void sweep_pages(page_size* ps, long max_bytes, cache_topology* topo, double ghz,
+        perf_counters* counters, uint64_t* state)
+{
+    long line_size = topo->line_size;
+    long max_pages = max_bytes / ps->page_bytes;
+    if (max_pages < MIN_PAGES)
+    {
+        printf("%s pages: %ld bytes available, less than %d pages, skipped\n\n",
+                ps->name, max_bytes, MIN_PAGES);
+        return;
+    }
+
+    alloc_buffer buf;
+    if (allocate_buffer(&buf, max_pages * ps->page_bytes, ps->backend) != 0)
+    {
+        printf("%s pages: not available, skipped\n\n", ps->name);
+        return;
+    }
+#if defined(__linux__) && defined(MADV_NOHUGEPAGE)
+    if (ps->backend == ALLOC_ALIGNED)
+        madvise(buf.ptr, buf.mapped, MADV_NOHUGEPAGE);
+#endif
+    // Fault every page in before timing
+    memset(buf.ptr, 0, max_pages * ps->page_bytes);
+
+    printf("%s pages (%s)\n", ps->name, alloc_backend_name(buf.backend));
+    printf("%12s %14s %12s %14s %18s\n", "Pages", "Reach Bytes", "ns/Load",
+            "Cycles/Load", "dTLB Misses/Load");
+
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    config.target_seconds = 0.05;
+    benchmark_stats stats;
+
+    long pages[MAX_POINTS];
+    double cycles[MAX_POINTS];
+    double miss_rate[MAX_POINTS];   // dTLB misses per load, or -1 if not counted
+    int n_points = 0;
+
+    // Powers of two, and halfway points between them
+    for (long base = MIN_PAGES; base <= max_pages && n_points < MAX_POINTS - 1; base *= 2)
+    {
+        long counts[2] = {base, base + base / 2};
+        for (int s = 0; s < 2; s++)
+        {
+            long n_pages = counts[s];
+            if (n_pages > max_pages)
+                break;
+            build_page_cycle((char*)buf.ptr, n_pages, ps->page_bytes, line_size, state);
+
+            tlb_args args;
+            args.start = (void**)buf.ptr;
+            args.end = NULL;
+            long n_loads = run_benchmark_calibrated(tlb_chase, NULL, &args, config, &stats);
+
+            // One more run with counters, for exact cycles and dTLB misses
+            counters_start(counters);
+            tlb_chase(&args, n_loads);
+            counters_stop(counters);
+            long long counted = get_counter(counters, COUNTER_CYCLES);
+            long long misses = get_counter(counters, COUNTER_DTLB_MISSES);
+            double cycles_per_load = counted > 0 ? (double)counted / n_loads
+                : stats.median * 1e9 * ghz;
+
+            pages[n_points] = n_pages;
+            miss_rate[n_points] = misses >= 0 ? (double)misses / n_loads : -1;
+            cycles[n_points++] = cycles_per_load;
+            printf("%12ld %14ld %12.2f %14.1f", n_pages, n_pages * ps->page_bytes,
+                    stats.median * 1e9, cycles_per_load);
+            if (misses >= 0)
+                printf(" %18.4f\n", (double)misses / n_loads);
+            else
+                printf(" %18s\n", "n/a");
+            fflush(stdout);
+            if (args.end == NULL)
+                printf("Chase ended on NULL\n");
+        }
+    }
+
+    // A step is a point that is STEP_RATIO above the start of the current
+    // plateau; the last page count before it is the number of entries
+    int plateau = 0;
+    int n_steps = 0;
+    for (int i = 1; i < n_points; i++)
+    {
+        if (cycles[i] <= STEP_RATIO * cycles[plateau])
+            continue;
+        printf("Step after %ld pages (%ld bytes of reach): %.1f -> %.1f cycles/load",
+                pages[i - 1], pages[i - 1] * ps->page_bytes, cycles[plateau], cycles[i]);
+
+        // Cache level whose size the touched lines passed at this point, if any
+        int level = 0;
+        for (int l = 1; l <= topo->n_levels && level == 0; l++)
+            if (cache_size(topo, l) > 0 && pages[i - 1] * line_size <= cache_size(topo, l)
+                    && pages[i] * line_size > cache_size(topo, l))
+                level = l;
+
+        if (miss_rate[i] >= 0 && miss_rate[plateau] >= 0)
+        {
+            if (miss_rate[i] - miss_rate[plateau] >= MISS_STEP)
+            {
+                printf(", TLB level of about %ld entries\n", pages[i - 1]);
+                n_steps++;
+            }
+            else
+                printf(", not a TLB level (dTLB misses/load %.4f -> %.4f)\n",
+                        miss_rate[plateau], miss_rate[i]);
+        }
+        else if (level > 0)
+            printf(", cache step (touched lines outgrow L%d), not a TLB level\n", level);
+        else
+        {
+            printf(", TLB level of about %ld entries\n", pages[i - 1]);
+            n_steps++;
+        }
+        plateau = i;
+    }
+    if (n_steps == 0)
+        printf("No TLB step up to %ld pages\n", pages[n_points - 1]);
+    printf("\n");
+
+    free_buffer(&buf);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* which = "4k,2m,1g";
+    long max_bytes = DEFAULT_MAX_BYTES;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--pages=", 8) == 0)
+            which = argv[i] + 8;
+        else if (strncmp(argv[i], "--max=", 6) == 0)
+            max_bytes = atol(argv[i] + 6);
+        else
+        {
+            printf("Usage: %s [--pages=4k,2m,1g] [--max=BYTES]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    print_cache_topology(&topo);
+
+    perf_counters counters;
+    counters_init(&counters);
+    double ghz = estimate_ghz();
+    printf("Estimated Clock %.2f GHz (used when the cycle counter is not available)\n\n", ghz);
+
+    page_size sizes[3] = {
+        {"4k", 4096L, ALLOC_ALIGNED},
+        {"2m", ALLOC_HUGE_2M, ALLOC_HUGETLB_2M},
+        {"1g", ALLOC_HUGE_1G, ALLOC_HUGETLB_1G}};
+    uint64_t state = chase_seed();
+
+    for (int p = 0; p < 3; p++)
+    {
+        if (strstr(which, sizes[p].name) == NULL)
+            continue;
+        long bytes = max_bytes;
+        if (sizes[p].backend != ALLOC_ALIGNED)
+        {
+            bytes = free_huge_pages(sizes[p].page_bytes) * sizes[p].page_bytes;
+            if (bytes > HUGE_MAX_BYTES)
+                bytes = HUGE_MAX_BYTES;
+        }
+        sweep_pages(&sizes[p], bytes, &topo, ghz, &counters, &state);
+    }
+
+    counters_close(&counters);
+    return 0;
+}
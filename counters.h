@@ -0,0 +1,231 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Hardware performance counters around a timed region (Linux perf_event_open)
+// Counts cycles, instructions, L1D and last-level cache misses, dTLB misses,
+// and branch misses, so a slowdown can be attributed to one of them.
+//
+// Usage :
+//     perf_counters counters;
+//     counters_init(&counters);
+//     counters_start(&counters);
+//     ... timed region ...
+//     counters_stop(&counters);
+//     print_counters(&counters, n_access);
+//     counters_close(&counters);
+//
+// All events are opened as one group, so they are measured over exactly
+// the same instructions.  Only user-space events are counted, which is
+// allowed with the default perf_event_paranoid setting of 2.  If counters
+// are not permitted (e.g. perf_event_paranoid of 3, or running in a container
+// or VM without a PMU), a single note is printed and every call becomes a no-op.
+// Events the CPU does not support are reported as "n/a".
+
+enum counter_event
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_DTLB_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_N
+};
+
+static const char* counter_names[COUNTER_N] = {"Cycles", "Instructions",
+    "L1D Misses", "LLC Misses", "dTLB Misses", "Branch Misses"};
+
+typedef struct
+{
+    int available;               // 0 if counters could not be opened at all
+    int fds[COUNTER_N];          // -1 for events that could not be opened
+    uint64_t ids[COUNTER_N];
+    int valid[COUNTER_N];        // 1 if values[i] was measured in the last region
+    long long values[COUNTER_N];
+    double scaling;              // time_running / time_enabled, < 1 if multiplexed
+} perf_counters;
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+long perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu,
+        int group_fd, unsigned long flags)
+{
+    return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// Returns the perf type and config for an event
+void counter_config(int event, uint32_t* type, uint64_t* config)
+{
+    uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    *type = PERF_TYPE_HARDWARE;
+    switch (event)
+    {
+        case COUNTER_CYCLES:
+            *config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case COUNTER_INSTRUCTIONS:
+            *config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case COUNTER_L1D_MISSES:
+            *type = PERF_TYPE_HW_CACHE;
+            *config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+            break;
+        case COUNTER_LLC_MISSES:
+            *type = PERF_TYPE_HW_CACHE;
+            *config = PERF_COUNT_HW_CACHE_LL | read_miss;
+            break;
+        case COUNTER_DTLB_MISSES:
+            *type = PERF_TYPE_HW_CACHE;
+            *config = PERF_COUNT_HW_CACHE_DTLB | read_miss;
+            break;
+        default:
+            *config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+void counters_init(perf_counters* c)
+{
+    struct perf_event_attr attr;
+    memset(c, 0, sizeof(perf_counters));
+
+    for (int i = 0; i < COUNTER_N; i++)
+    {
+        c->fds[i] = -1;
+        int group_fd = i == 0 ? -1 : c->fds[0];
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        uint32_t type;
+        uint64_t config;
+        counter_config(i, &type, &config);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = (i == 0);   // The leader starts and stops the whole group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID
+            | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        c->fds[i] = (int)perf_event_open(&attr, 0, -1, group_fd, 0);
+        if (c->fds[i] >= 0)
+            ioctl(c->fds[i], PERF_EVENT_IOC_ID, &c->ids[i]);
+        else if (i == 0)
+        {
+            // Without a group leader, nothing else can be counted
+            fprintf(stderr, "counters.h : perf_event_open failed (%s), counters disabled\n"
+                    "             check /proc/sys/kernel/perf_event_paranoid\n", strerror(errno));
+            return;
+        }
+    }
+    c->available = 1;
+}
+
+void counters_start(perf_counters* c)
+{
+    if (!c->available) return;
+    ioctl(c->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(c->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void counters_stop(perf_counters* c)
+{
+    // nr, time_enabled, time_running, then {value, id} per event
+    uint64_t buf[3 + 2*COUNTER_N];
+
+    for (int i = 0; i < COUNTER_N; i++)
+        c->valid[i] = 0;
+    if (!c->available) return;
+
+    ioctl(c->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (read(c->fds[0], buf, sizeof(buf)) <= 0)
+        return;
+
+    uint64_t nr = buf[0];
+    uint64_t enabled = buf[1];
+    uint64_t running = buf[2];
+
+    // A group that was never scheduled on the PMU (too many events) has no data
+    if (running == 0)
+        return;
+    c->scaling = (double)running / enabled;
+
+    for (uint64_t k = 0; k < nr; k++)
+    {
+        uint64_t value = buf[3 + 2*k];
+        uint64_t id = buf[4 + 2*k];
+        for (int i = 0; i < COUNTER_N; i++)
+        {
+            if (c->fds[i] >= 0 && c->ids[i] == id)
+            {
+                // Scale up if the group was multiplexed with other users of the PMU
+                c->values[i] = (long long)(value / c->scaling);
+                c->valid[i] = 1;
+            }
+        }
+    }
+}
+
+void counters_close(perf_counters* c)
+{
+    for (int i = COUNTER_N - 1; i >= 0; i--)
+        if (c->available && c->fds[i] >= 0)
+            close(c->fds[i]);
+    c->available = 0;
+}
+
+#else
+
+void counters_init(perf_counters* c)
+{
+    memset(c, 0, sizeof(perf_counters));
+    fprintf(stderr, "counters.h : hardware counters are only supported on Linux\n");
+}
+void counters_start(perf_counters* c) {}
+void counters_stop(perf_counters* c) {}
+void counters_close(perf_counters* c) {}
+
+#endif
+
+// Returns the value of an event in the last region, or -1 if it was not measured
+long long get_counter(perf_counters* c, int event)
+{
+    if (!c->available || !c->valid[event]) return -1;
+    return c->values[event];
+}
+
+// Print IPC, and each miss count per access (n_access loads/stores in the region)
+void print_counters(perf_counters* c, long n_access)
+{
+    if (!c->available) return;
+
+    long long cycles = get_counter(c, COUNTER_CYCLES);
+    long long instructions = get_counter(c, COUNTER_INSTRUCTIONS);
+    if (cycles > 0 && instructions >= 0)
+        printf("   IPC %.3f", (double)instructions / cycles);
+    else
+        printf("   IPC n/a");
+
+    for (int i = COUNTER_L1D_MISSES; i < COUNTER_N; i++)
+    {
+        long long misses = get_counter(c, i);
+        if (misses >= 0)
+            printf(", %s Per Access %.4f", counter_names[i], (double)misses / n_access);
+        else
+            printf(", %s n/a", counter_names[i]);
+    }
+    printf("\n");
+}
+
+#endif
@@ -5,6 +5,41 @@
 #include <math.h>
 
 #include "mpi_cannon.hpp"
+#include "profiler.hpp"
+#include "../../../benchmark.h"
+#include "../../../mpi_timer.h"
+
+// The Cannon variant to time, and its local matrices and process grid
+struct cannon_args
+{
+    void (*method)(float*, float*, float*, int, int, int, int);
+    float* A;
+    float* B;
+    float* C;
+    int n;
+    int sq_num_procs;
+    int rank_row;
+    int rank_col;
+    double local_total;     // This process's own time, summed over samples
+    int local_count;
+};
+
+// Time one call on every process, returning the slowest process's time
+// All processes get the same sample, so all stop sampling at the same point
+double time_cannon(void* data)
+{
+    cannon_args* args = (cannon_args*)data;
+    double start, elapsed, max_elapsed;
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    args->method(args->A, args->B, args->C, args->n, args->sq_num_procs,
+            args->rank_row, args->rank_col);
+    elapsed = MPI_Wtime() - start;
+    args->local_total += elapsed;
+    args->local_count++;
+    MPI_Allreduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return max_elapsed;
+}
 
 // Main Method : 
 //     Splits processes into a process grid
@@ -83,34 +118,44 @@ int main(int argc, char* argv[])
         }
     }
     
-    float start, end;
+    cannon_args args = {mpi_cannon, h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col, 0, 0};
+    benchmark_config config = default_benchmark_config();
+    benchmark_stats stats;
 
     // Time Cannon's Method
-    mpi_cannon(h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col);
-    MPI_Barrier(MPI_COMM_WORLD);
-    start = MPI_Wtime();
-    mpi_cannon(h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col);
-    end = MPI_Wtime() - start;
-    MPI_Reduce(&end, &start, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Cannon's Method on CPU: Elapsed Time %e\n", start);
+    // Profiled regions split each rotation step into communicate and matmat
+    profiler_synchronize();
+    args.method = mpi_cannon;
+    args.local_total = 0;
+    args.local_count = 0;
+    run_benchmark_samples(time_cannon, &args, config, &stats);
+    if (rank == 0) printf("Cannon's Method on CPU: Elapsed Time %e\n", stats.median);
+    if (rank == 0) print_stats("Cannon's Method on CPU", &stats);
+    report_phase_timing("Cannon's Method on CPU (per rank)", args.local_total / args.local_count,
+            MPI_COMM_WORLD);
+    profiler_write_trace("cannon_trace.json");
+    if (rank == 0) profiler_print_summary();
+    profiler_reset();
 
     // Time CUDA-Aware Cannon's Method
-    cuda_aware_cannon(h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col);
-    MPI_Barrier(MPI_COMM_WORLD);
-    start = MPI_Wtime();
-    cuda_aware_cannon(h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col);
-    end = MPI_Wtime() - start;
-    MPI_Reduce(&end, &start, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("CUDA-Aware Cannon's Method: Elapsed Time %e\n", start);
+    args.method = cuda_aware_cannon;
+    args.local_total = 0;
+    args.local_count = 0;
+    run_benchmark_samples(time_cannon, &args, config, &stats);
+    if (rank == 0) printf("CUDA-Aware Cannon's Method: Elapsed Time %e\n", stats.median);
+    if (rank == 0) print_stats("CUDA-Aware Cannon's Method", &stats);
+    report_phase_timing("CUDA-Aware Cannon's Method (per rank)", args.local_total / args.local_count,
+            MPI_COMM_WORLD);
 
     // Time Copy-to-CPU Cannon's Method
-    copy_to_cpu_cannon(h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col);
-    MPI_Barrier(MPI_COMM_WORLD);
-    start = MPI_Wtime();
-    copy_to_cpu_cannon(h_A, h_B, h_C, n, sq_num_procs, rank_row, rank_col);
-    end = MPI_Wtime() - start;
-    MPI_Reduce(&end, &start, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Copy-to-CPU Cannon's Method: Elapsed Time %e\n", start);
+    args.method = copy_to_cpu_cannon;
+    args.local_total = 0;
+    args.local_count = 0;
+    run_benchmark_samples(time_cannon, &args, config, &stats);
+    if (rank == 0) printf("Copy-to-CPU Cannon's Method: Elapsed Time %e\n", stats.median);
+    if (rank == 0) print_stats("Copy-to-CPU Cannon's Method", &stats);
+    report_phase_timing("Copy-to-CPU Cannon's Method (per rank)", args.local_total / args.local_count,
+            MPI_COMM_WORLD);
 
     delete[] h_A;
     delete[] h_B;
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "profiler.hpp"
+
+thread_local profile_thread* profiler_current_thread = NULL;
+
+static std::mutex profiler_mutex;
+static std::vector<std::unique_ptr<profile_thread>> profiler_threads;
+static uint64_t profiler_epoch = profiler_ticks();
+
+// Ticks and nanoseconds at program start, to measure the tick rate
+static uint64_t profiler_calibration_ticks = profiler_ticks();
+static uint64_t profiler_calibration_ns = profiler_now();
+
+// Called once per thread, so the lock is never taken while recording
+profile_thread* profiler_register_thread()
+{
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    profile_thread* thread = new profile_thread;
+    thread->tid = (int)profiler_threads.size();
+    thread->events.reserve(PROFILER_MAX_EVENTS);
+    thread->dropped = 0;
+    thread->open.reserve(64);
+    profiler_threads.emplace_back(thread);
+    return thread;
+}
+
+// Seconds per tick, measured over everything since program start
+// (waiting at least 10ms, so the measurement is accurate)
+double profiler_seconds_per_tick()
+{
+    while (profiler_now() - profiler_calibration_ns < 10000000);
+    uint64_t ticks = profiler_ticks();
+    uint64_t ns = profiler_now();
+    return (ns - profiler_calibration_ns) * 1e-9 / (ticks - profiler_calibration_ticks);
+}
+
+int profiler_rank()
+{
+    int initialized, finalized, rank = 0;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if (initialized && !finalized)
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+}
+
+int profiler_mpi_active()
+{
+    int initialized, finalized;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    return initialized && !finalized;
+}
+
+void profiler_synchronize()
+{
+    if (profiler_mpi_active())
+        MPI_Barrier(MPI_COMM_WORLD);
+    profiler_epoch = profiler_ticks();
+}
+
+void profiler_reset()
+{
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    for (auto& thread : profiler_threads)
+    {
+        // Keep open regions, moved to the front, each the parent of the next
+        std::vector<profile_event> kept;
+        for (int& idx : thread->open)
+        {
+            if (idx < 0)
+                continue;
+            profile_event e = thread->events[idx];
+            e.parent = kept.empty() ? -1 : (int)kept.size() - 1;
+            kept.push_back(e);
+            idx = (int)kept.size() - 1;
+        }
+        thread->events.clear();
+        thread->events.insert(thread->events.end(), kept.begin(), kept.end());
+        thread->dropped = 0;
+    }
+}
+
+// Serialize this rank's completed events as comma-separated trace events
+std::string profiler_local_trace(int rank)
+{
+    std::string trace;
+    char buf[512];
+    double us_per_tick = 1e6 * profiler_seconds_per_tick();
+
+    snprintf(buf, sizeof(buf), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"Rank %d\"}}", rank, rank);
+    trace += buf;
+
+    std::lock_guard<std::mutex> lock(profiler_mutex);
+    for (auto& thread : profiler_threads)
+    {
+        for (const profile_event& e : thread->events)
+        {
+            if (e.end == 0 || e.start < profiler_epoch)
+                continue;
+            snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%d}", e.name,
+                    (e.start - profiler_epoch) * us_per_tick, (e.end - e.start) * us_per_tick,
+                    rank, thread->tid);
+            trace += buf;
+        }
+    }
+    return trace;
+}
+
+void profiler_write_trace(const char* filename)
+{
+    int rank = profiler_rank();
+    std::string local = profiler_local_trace(rank);
+    std::string all;
+
+    if (profiler_mpi_active())
+    {
+        int num_procs;
+        MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+        int size = (int)local.size();
+        std::vector<int> sizes(num_procs);
+        std::vector<int> displs(num_procs + 1, 0);
+        MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (rank == 0)
+        {
+            for (int i = 0; i < num_procs; i++)
+                displs[i+1] = displs[i] + sizes[i];
+            all.resize(displs[num_procs]);
+        }
+        MPI_Gatherv(local.data(), size, MPI_CHAR, rank == 0 ? &all[0] : NULL,
+                sizes.data(), displs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+        // Each rank's events are comma-separated, so join ranks with a comma
+        if (rank == 0)
+        {
+            std::string joined;
+            for (int i = 0; i < num_procs; i++)
+            {
+                if (i) joined += ",\n";
+                joined.append(all, displs[i], sizes[i]);
+            }
+            all.swap(joined);
+        }
+    }
+    else
+        all = local;
+
+    if (rank != 0)
+        return;
+
+    FILE* f = fopen(filename, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "profiler : could not open %s\n", filename);
+        return;
+    }
+    fprintf(f, "{\"traceEvents\":[\n%s\n],\"displayTimeUnit\":\"ms\"}\n", all.c_str());
+    fclose(f);
+}
+
+struct profile_summary
+{
+    long count;
+    double total, min, max;
+};
+
+void profiler_print_summary(FILE* out)
+{
+    std::map<std::string, profile_summary> regions;
+    double root_total = 0;
+    long dropped = 0;
+    double seconds_per_tick = profiler_seconds_per_tick();
+
+    {
+        std::lock_guard<std::mutex> lock(profiler_mutex);
+        for (auto& thread : profiler_threads)
+        {
+            dropped += thread->dropped;
+
+            // Paths are built from parents, which always come earlier in the buffer
+            std::vector<std::string> paths(thread->events.size());
+            for (size_t i = 0; i < thread->events.size(); i++)
+            {
+                const profile_event& e = thread->events[i];
+                if (e.parent < 0)
+                    paths[i] = e.name;
+                else
+                    paths[i] = paths[e.parent] + "/" + e.name;
+                if (e.end == 0)
+                    continue;
+
+                double seconds = (e.end - e.start) * seconds_per_tick;
+                auto it = regions.find(paths[i]);
+                if (it == regions.end())
+                    regions[paths[i]] = {1, seconds, seconds, seconds};
+                else
+                {
+                    profile_summary& s = it->second;
+                    s.count++;
+                    s.total += seconds;
+                    if (seconds < s.min) s.min = seconds;
+                    if (seconds > s.max) s.max = seconds;
+                }
+                if (e.parent < 0)
+                    root_total += seconds;
+            }
+        }
+    }
+
+    fprintf(out, "Rank %d profile:\n", profiler_rank());
+    fprintf(out, "%-48s %8s %12s %12s %12s %12s %7s\n", "Region", "Count",
+            "Total", "Mean", "Min", "Max", "%");
+    for (auto& it : regions)
+    {
+        const profile_summary& s = it.second;
+        fprintf(out, "%-48s %8ld %12.4e %12.4e %12.4e %12.4e %6.2f%%\n",
+                it.first.c_str(), s.count, s.total, s.total / s.count, s.min, s.max,
+                root_total > 0 ? 100.0 * s.total / root_total : 0.0);
+    }
+    if (dropped > 0)
+        fprintf(out, "%ld regions dropped (more than PROFILER_MAX_EVENTS = %d per thread "
+                "since the last reset)\n", dropped, PROFILER_MAX_EVENTS);
+}
@@ -0,0 +1,143 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+// Scoped-region profiler
+//     PROFILE_REGION("communicate");   // times until the end of the enclosing scope
+// Regions nest, so each recorded region knows its parent, and a flat summary
+// can be printed per path (e.g. mpi_cannon/rotation/matmat).
+// Every thread records into its own buffer, so recording never takes a lock
+// and costs two cycle-counter reads plus a push onto a preallocated vector
+// (well under 50ns), so regions can be left in production builds.
+// Each thread keeps at most PROFILER_MAX_EVENTS regions between resets, so
+// the buffer never reallocates; further regions are dropped and counted.
+//
+// After a run:
+//     profiler_write_trace("trace.json");  // Collective : rank 0 writes one
+//                                          // Chrome trace (chrome://tracing,
+//                                          // ui.perfetto.dev) with one track
+//                                          // per rank and thread
+//     profiler_print_summary();            // Flat table for this rank
+//
+// Compile with -DPROFILER_DISABLE to remove all regions.
+
+#ifndef PROFILER_MAX_EVENTS
+#define PROFILER_MAX_EVENTS (1 << 16)
+#endif
+
+struct profile_event
+{
+    const char* name;   // Must outlive the profiler (string literals)
+    int parent;         // Index of enclosing event in the same thread, or -1
+    uint64_t start;     // Ticks, from profiler_ticks()
+    uint64_t end;
+};
+
+struct profile_thread
+{
+    int tid;
+    std::vector<profile_event> events;
+    std::vector<int> open;  // Stack of currently open events, -1 if dropped
+    long dropped;           // Regions not recorded because the buffer was full
+};
+
+// Monotonic nanoseconds
+inline uint64_t profiler_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Raw timestamp
+// Reads the invariant cycle counter where available (unfenced, as the
+// overhead matters more here than a few cycles of skew), otherwise
+// CLOCK_MONOTONIC.  Ticks are converted to seconds against CLOCK_MONOTONIC
+// only when the profile is written.
+inline uint64_t profiler_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t val;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(val));
+    return val;
+#else
+    return profiler_now();
+#endif
+}
+
+// Each thread registers its buffer once, on its first region
+extern thread_local profile_thread* profiler_current_thread;
+profile_thread* profiler_register_thread();
+
+inline profile_thread* profiler_thread()
+{
+    if (!profiler_current_thread)
+        profiler_current_thread = profiler_register_thread();
+    return profiler_current_thread;
+}
+
+class scoped_region
+{
+  public:
+    scoped_region(const char* name)
+    {
+        thread = profiler_thread();
+        if (thread->events.size() >= PROFILER_MAX_EVENTS)
+        {
+            thread->dropped++;
+            thread->open.push_back(-1);
+            return;
+        }
+        int idx = (int)thread->events.size();
+        int parent = thread->open.empty() ? -1 : thread->open.back();
+        thread->open.push_back(idx);
+        thread->events.push_back({name, parent, 0, 0});
+        thread->events[idx].start = profiler_ticks();
+    }
+
+    // Regions nest, so this region is the innermost open one
+    // (profiler_reset may have moved it to a new index)
+    ~scoped_region()
+    {
+        uint64_t end = profiler_ticks();
+        int idx = thread->open.back();
+        if (idx >= 0)
+            thread->events[idx].end = end;
+        thread->open.pop_back();
+    }
+
+  private:
+    profile_thread* thread;
+};
+
+#ifdef PROFILER_DISABLE
+#define PROFILE_REGION(name)
+#else
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILE_REGION(name) scoped_region PROFILER_CONCAT(profile_region_, __LINE__)(name)
+#endif
+
+// Synchronize all ranks and restart the clock, so tracks from different
+// ranks line up in the trace (collective if MPI is initialized)
+void profiler_synchronize();
+
+// Discard all recorded events, except regions that are still open, which
+// are kept (and still recorded when they close).  Not thread-safe against
+// threads that are recording at the same time.
+void profiler_reset();
+
+// Write Chrome trace-event JSON (collective if MPI is initialized)
+void profiler_write_trace(const char* filename);
+
+// Print count, total, mean, min, max and percent of total time for each region path
+// (and the number of regions dropped because a buffer was full)
+void profiler_print_summary(FILE* out = stdout);
+
+#endif
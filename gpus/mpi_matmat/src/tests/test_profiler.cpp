@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+#include <mpi.h>
+#include "profiler.hpp"
+
+#include <map>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    MPI_Init(&argc, &argv);
+    ::testing::InitGoogleTest(&argc, argv);
+    int temp=RUN_ALL_TESTS();
+    MPI_Finalize();
+    return temp;
+} // end of main() //
+
+// Count column of profiler_print_summary, by region path
+std::map<std::string, long> summary_counts()
+{
+    std::map<std::string, long> counts;
+    FILE* f = tmpfile();
+    profiler_print_summary(f);
+    rewind(f);
+    char line[256];
+    char path[256];
+    long count;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "%255s %ld", path, &count) == 2)
+            counts[path] = count;
+    fclose(f);
+    return counts;
+}
+
+TEST(ProfilerTest, TestsInProfiler)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    profiler_synchronize();
+    profiler_reset();
+    for (int i = 0; i < 3; i++)
+    {
+        PROFILE_REGION("outer");
+        {
+            PROFILE_REGION("inner");
+        }
+    }
+
+    // Summary should hold one line per region path
+    std::map<std::string, long> counts = summary_counts();
+    ASSERT_EQ(counts["outer"], 3);
+    ASSERT_EQ(counts["outer/inner"], 3);
+
+    // Rank 0 writes one trace with a track for every rank
+    profiler_write_trace("test_trace.json");
+    if (rank == 0)
+    {
+        int num_procs;
+        MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+        FILE* f = fopen("test_trace.json", "r");
+        ASSERT_TRUE(f != NULL);
+        std::string trace;
+        char line[256];
+        while (fgets(line, sizeof(line), f))
+            trace += line;
+        fclose(f);
+        for (int p = 0; p < num_procs; p++)
+        {
+            std::string track = "\"pid\":" + std::to_string(p) + ",";
+            ASSERT_NE(trace.find(track), std::string::npos);
+        }
+        ASSERT_NE(trace.find("\"name\":\"inner\""), std::string::npos);
+    }
+} // end of  TEST(ProfilerTest, TestsInProfiler) //
+
+TEST(ProfilerTest, ResetWithOpenRegion)
+{
+    profiler_reset();
+    {
+        PROFILE_REGION("open");
+        {
+            PROFILE_REGION("before");
+        }
+
+        // The open region is kept, and its children after the reset nest under it
+        profiler_reset();
+        for (int i = 0; i < 2; i++)
+        {
+            PROFILE_REGION("after");
+        }
+    }
+
+    std::map<std::string, long> counts = summary_counts();
+    ASSERT_EQ(counts["open"], 1);
+    ASSERT_EQ(counts["open/after"], 2);
+    ASSERT_EQ(counts.count("open/before"), 0);
+} // end of  TEST(ProfilerTest, ResetWithOpenRegion) //
@@ -1,6 +1,7 @@
 #include "mpi.h"
 #include "stdlib.h"
 #include "stdio.h"
+#include "../mpi_timer.h"
 
 void extra_messages(int* mat, int* col, int n, int idx)
 {
@@ -90,8 +91,7 @@ int main(int argc, char* argv[])
     for (int i = 0; i < n_iter; i++)
         extra_messages(mat, col, n, col_idx);
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Extra Msg Cost: %e\n", t0);
+    report_phase_timing("Extra Msg Cost", tfinal, MPI_COMM_WORLD);
 
     n_iter = 10000;
 
@@ -101,8 +101,7 @@ int main(int argc, char* argv[])
     for (int i = 0; i < n_iter; i++)
         extra_copy(mat, col, n, col_idx);
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Extra Copy Cost: %e\n", t0);
+    report_phase_timing("Extra Copy Cost", tfinal, MPI_COMM_WORLD);
 
     MPI_Datatype col_type;
     MPI_Type_vector(n, 1, n, MPI_INT, &col_type);
@@ -113,8 +112,7 @@ int main(int argc, char* argv[])
     for (int i = 0; i < n_iter; i++)
         datatype_col(mat, col, n, col_idx, col_type);
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Col Datatype Cost: %e\n", t0);
+    report_phase_timing("Col Datatype Cost", tfinal, MPI_COMM_WORLD);
 
     MPI_Type_free(&col_type);
 
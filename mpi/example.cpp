@@ -1,6 +1,7 @@
 #include "mpi.h"
 #include "stdlib.h"
 #include "stdio.h"
+#include "../mpi_timer.h"
 
 void send_column(int* mat, int* col, int n, int idx)
 {
@@ -41,8 +42,7 @@ int main(int argc, char* argv[])
     for (int i = 0; i < n_iter; i++)
         send_column(mat, col, n, col_idx);
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Cost of Sending Column: %e\n", t0);
+    report_phase_timing("Cost of Sending Column", tfinal, MPI_COMM_WORLD);
 
 
 
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "mpi.h"
+#include "../mpi_timer.h"
 
 void simple_test(int buf_size)
 {
@@ -13,15 +14,21 @@ void simple_test(int buf_size)
     MPI_File_open(MPI_COMM_WORLD, "test.out", 
             MPI_MODE_CREATE|MPI_MODE_WRONLY,
             MPI_INFO_NULL, &file);
+    // Only ranks 0 and 1 write, so only they record latencies
+    latency_histogram* hist = (latency_histogram*)malloc(sizeof(latency_histogram));
+    histogram_init(hist);
     double t0 = MPI_Wtime();
     for (int i = 0; i < 1000; i++)
     {
+        double t1 = MPI_Wtime();
         if (rank == 0) MPI_File_write_shared(file, buf, buf_size, MPI_INT, MPI_STATUS_IGNORE);
         if (rank == 1) MPI_File_write_shared(file, buf, buf_size, MPI_INT, MPI_STATUS_IGNORE);
+        if (rank < 2) histogram_record(hist, MPI_Wtime() - t1);
     }
     double tfinal = (MPI_Wtime() - t0) / 1000;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Time %e\n", t0);
+    report_phase_timing("Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("Write Shared Latency", hist, MPI_COMM_WORLD);
+    free(hist);
     MPI_File_close(&file);
 
     free(buf);
@@ -308,7 +315,7 @@ int main(int argc, char* argv[])
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
 
-    double t0, tfinal;
+    double t0, t1, tfinal;
     simple_test(1024);
 
     int n = 1024; 
@@ -328,50 +335,82 @@ int main(int argc, char* argv[])
     write_mat();
 
     int n_iter = 10;
+    latency_histogram* hist = (latency_histogram*)malloc(sizeof(latency_histogram));
 
+    histogram_init(hist);
     t0 = MPI_Wtime();
     for (int i = 0; i < n_iter; i++)
+    {
+        t1 = MPI_Wtime();
         seek_read(A, n, local_n, first);
+        histogram_record(hist, MPI_Wtime() - t1);
+    }
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Seek and Read Time %e\n", t0);
+    report_phase_timing("Seek and Read Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("Seek and Read Latency", hist, MPI_COMM_WORLD);
 
+    histogram_init(hist);
     t0 = MPI_Wtime();
     for (int i = 0; i < n_iter; i++)
+    {
+        t1 = MPI_Wtime();
         seek_read_all(A, n, local_n, first);
+        histogram_record(hist, MPI_Wtime() - t1);
+    }
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Seek and ReadAll Time %e\n", t0);
+    report_phase_timing("Seek and ReadAll Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("Seek and ReadAll Latency", hist, MPI_COMM_WORLD);
 
+    histogram_init(hist);
     t0 = MPI_Wtime();
     for (int i = 0; i < n_iter; i++)
+    {
+        t1 = MPI_Wtime();
         read_at(A, n, local_n, first);
+        histogram_record(hist, MPI_Wtime() - t1);
+    }
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Read At Time %e\n", t0);
+    report_phase_timing("Read At Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("Read At Latency", hist, MPI_COMM_WORLD);
 
+    histogram_init(hist);
     t0 = MPI_Wtime();
     for (int i = 0; i < n_iter; i++)
+    {
+        t1 = MPI_Wtime();
         read_at_all(A, n, local_n, first);
+        histogram_record(hist, MPI_Wtime() - t1);
+    }
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("Read At All Time %e\n", t0);
+    report_phase_timing("Read At All Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("Read At All Latency", hist, MPI_COMM_WORLD);
 
 
+    histogram_init(hist);
     t0 = MPI_Wtime();
     for (int i = 0; i < n_iter; i++)
+    {
+        t1 = MPI_Wtime();
         view_read(A, n, local_n, first);
+        histogram_record(hist, MPI_Wtime() - t1);
+    }
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("View and Read Time %e\n", t0);
+    report_phase_timing("View and Read Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("View and Read Latency", hist, MPI_COMM_WORLD);
 
+    histogram_init(hist);
     t0 = MPI_Wtime();
     for (int i = 0; i < n_iter; i++)
+    {
+        t1 = MPI_Wtime();
         view_read_all(A, n, local_n, first);
+        histogram_record(hist, MPI_Wtime() - t1);
+    }
     tfinal = (MPI_Wtime() - t0) / n_iter;
-    MPI_Reduce(&tfinal, &t0, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-    if (rank == 0) printf("View and ReadAll Time %e\n", t0);
+    report_phase_timing("View and ReadAll Time", tfinal, MPI_COMM_WORLD);
+    report_histogram("View and ReadAll Latency", hist, MPI_COMM_WORLD);
 
+    free(hist);
     free(A);
 
     return MPI_Finalize();
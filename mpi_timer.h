@@ -0,0 +1,123 @@
+#ifndef MPI_TIMER_H
+#define MPI_TIMER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include "timer.h"
+
+// Cross-rank timing aggregation
+// Reducing only the MAX time to rank 0 hides whether one slow rank or
+// uniform slowness is the problem.  Instead, gather every rank's time for a
+// phase and report min/avg/max, the imbalance factor (max / avg, 1.0 is
+// perfectly balanced), and which ranks were slowest.
+//
+// Usage (collective over comm) :
+//     t0 = MPI_Wtime();
+//     ... phase ...
+//     tfinal = MPI_Wtime() - t0;
+//     report_phase_timing("Phase Name", tfinal, MPI_COMM_WORLD);
+
+// Number of slowest ranks to report
+#ifndef MPI_TIMER_N_SLOWEST
+#define MPI_TIMER_N_SLOWEST 3
+#endif
+
+typedef struct
+{
+    double min, avg, max;
+    double imbalance;                       // max / avg
+    int n_slowest;                          // min(MPI_TIMER_N_SLOWEST, num_procs)
+    int slowest[MPI_TIMER_N_SLOWEST];       // Slowest ranks, slowest first
+    double slowest_time[MPI_TIMER_N_SLOWEST];
+} phase_timing;
+
+// Gather seconds from every rank in comm, and summarize on root
+// (timing is only filled in on root)
+void gather_phase_timing(double seconds, int root, MPI_Comm comm, phase_timing* timing)
+{
+    int rank, num_procs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_procs);
+
+    double* times = NULL;
+    if (rank == root)
+        times = (double*)malloc(num_procs*sizeof(double));
+    MPI_Gather(&seconds, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, root, comm);
+    if (rank != root)
+        return;
+
+    timing->min = times[0];
+    timing->max = times[0];
+    timing->avg = 0;
+    for (int i = 0; i < num_procs; i++)
+    {
+        if (times[i] < timing->min) timing->min = times[i];
+        if (times[i] > timing->max) timing->max = times[i];
+        timing->avg += times[i];
+    }
+    timing->avg /= num_procs;
+    timing->imbalance = timing->avg > 0 ? timing->max / timing->avg : 1.0;
+
+    // Partial selection of the slowest ranks
+    timing->n_slowest = num_procs < MPI_TIMER_N_SLOWEST ? num_procs : MPI_TIMER_N_SLOWEST;
+    for (int k = 0; k < timing->n_slowest; k++)
+    {
+        int slowest = -1;
+        for (int i = 0; i < num_procs; i++)
+            if (times[i] >= 0 && (slowest < 0 || times[i] > times[slowest]))
+                slowest = i;
+        timing->slowest[k] = slowest;
+        timing->slowest_time[k] = times[slowest];
+        times[slowest] = -1;
+    }
+
+    free(times);
+}
+
+void print_phase_timing(const char* phase, phase_timing* timing)
+{
+    printf("%s: Max %e, Avg %e, Min %e, Imbalance %.2f, Slowest Ranks",
+            phase, timing->max, timing->avg, timing->min, timing->imbalance);
+    for (int k = 0; k < timing->n_slowest; k++)
+        printf("%s %d (%e)", k ? "," : "", timing->slowest[k], timing->slowest_time[k]);
+    printf("\n");
+}
+
+// Gather seconds from every rank and print the summary on rank 0 of comm
+void report_phase_timing(const char* phase, double seconds, MPI_Comm comm)
+{
+    int rank;
+    phase_timing timing;
+    MPI_Comm_rank(comm, &rank);
+    gather_phase_timing(seconds, 0, comm, &timing);
+    if (rank == 0)
+        print_phase_timing(phase, &timing);
+}
+
+// Merge latency histograms (see timer.h) from every rank in comm onto root
+// (merged must be allocated on every rank, but is only filled in on root)
+void reduce_histogram(const latency_histogram* hist, int root, MPI_Comm comm,
+        latency_histogram* merged)
+{
+    MPI_Reduce(hist->counts, merged->counts, HISTOGRAM_BUCKETS, MPI_UINT64_T,
+            MPI_SUM, root, comm);
+    MPI_Reduce(&hist->total, &merged->total, 1, MPI_UINT64_T, MPI_SUM, root, comm);
+    MPI_Reduce(&hist->min_ns, &merged->min_ns, 1, MPI_UINT64_T, MPI_MIN, root, comm);
+    MPI_Reduce(&hist->max_ns, &merged->max_ns, 1, MPI_UINT64_T, MPI_MAX, root, comm);
+    MPI_Reduce(&hist->sum, &merged->sum, 1, MPI_DOUBLE, MPI_SUM, root, comm);
+}
+
+// Merge histograms from every rank and print percentiles on rank 0 of comm
+void report_histogram(const char* phase, const latency_histogram* hist, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    latency_histogram* merged = (latency_histogram*)malloc(sizeof(latency_histogram));
+    reduce_histogram(hist, 0, comm, merged);
+    if (rank == 0)
+        print_histogram(phase, merged);
+    free(merged);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "timer.h"
+#include "benchmark.h"
 
 // To compile with and without vectorization (in gcc):
 // gcc -o dependencies dependencies.c -O1     <--- no vectorization
@@ -15,9 +16,9 @@
 
 // An example loop that my compiler is able to vectorize
 // GCC can detect that this loop can be rewritten without dependencies
-void loop(int n, float* x, float* y, float* z, int n_iter)
+void loop(int n, float* x, float* y, float* z, long n_iter)
 {
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
 #pragma omp simd aligned(x, y, z) 
         for (int i = 1; i < n; i++)
@@ -28,9 +29,9 @@ void loop(int n, float* x, float* y, float* z, int n_iter)
 }
 
 // An example loop that cannot be vectorized
-void loop_not_vec(int n, float* x, float* y, float* z, int n_iter)
+void loop_not_vec(int n, float* x, float* y, float* z, long n_iter)
 {
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 1; i < n; i++)
         {
@@ -40,9 +41,9 @@ void loop_not_vec(int n, float* x, float* y, float* z, int n_iter)
 }
 
 // An example loop that some compilers may vectorize (my compiler can) 
-void loop_maybe_vec(int n, float* x, float* y, float* z, int n_iter)
+void loop_maybe_vec(int n, float* x, float* y, float* z, long n_iter)
 {
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
 #pragma omp simd safelen(4) 
         for (int i = 4; i < n; i++)
@@ -61,9 +62,9 @@ void loop_maybe_vec(int n, float* x, float* y, float* z, int n_iter)
 // the optimizer was unable to perform the requested transformation; 
 // the transformation might be disabled or specified as part of an 
 // unsupported transformation ordering [-Wpass-failed=transform-warning]
-void loop_unrolled(int n, float* x, float* y, float* z, int n_iter)
+void loop_unrolled(int n, float* x, float* y, float* z, long n_iter)
 {
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 4; i < n; i+=4)
         {
@@ -95,10 +96,44 @@ void reset_vectors(int n, float* x, float* y, float* z)
     x[n] = 1.0 / (n+1);
 }
 
+// Everything a loop needs, so the benchmark harness can call it repeatedly
+typedef void (*loop_method)(int n, float* x, float* y, float* z, long n_iter);
+typedef struct
+{
+    loop_method loop;
+    int n;
+    float* x;
+    float* y;
+    float* z;
+} loop_args;
+
+void loop_kernel(void* data, long n_iter)
+{
+    loop_args* args = (loop_args*)data;
+    args->loop(args->n, args->x, args->y, args->z, n_iter);
+}
+
+void loop_reset(void* data)
+{
+    loop_args* args = (loop_args*)data;
+    reset_vectors(args->n, args->x, args->y, args->z);
+}
+
+// Time a loop, calibrating the number of passes over the vectors so that
+// small and large n both take a predictable amount of time
+void time_loop(const char* label, loop_method loop, int n, float* x, float* y, float* z)
+{
+    loop_args args = {loop, n, x, y, z};
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 10;
+    benchmark_stats stats;
+    run_benchmark_calibrated(loop_kernel, loop_reset, &args, config, &stats);
+    printf("%s Val %e, Time Per Pass %e, Time Per Element %e\n", label, norm(n, z),
+            stats.median, stats.median / n);
+}
+
 int main(int argc, char* argv[])
 {
-    double start, end;
-    int n_access = 1000000000;
 
     if (argc == 1)
     {
@@ -107,7 +142,6 @@ int main(int argc, char* argv[])
     }
 
     int n = atoi(argv[1]);
-    int n_iter = n_access / n;
 
     float* x = (float*)malloc((n+1)*sizeof(float));
     float* y = (float*)malloc(n*sizeof(float));
@@ -115,45 +149,25 @@ int main(int argc, char* argv[])
 
 
     // Test vectorizable loop
-    reset_vectors(n, x, y, z);
-    start = get_time();
-    loop(n, x, y, z, n_iter);
-    end = get_time();
-    printf("Loop 1 (should be vectorizable) Val %e, Time %e\n", norm(n, z), end - start);
+    time_loop("Loop 1 (should be vectorizable)", loop, n, x, y, z);
 
 
     // Test not vectorizable loop
-    reset_vectors(n, x, y, z);
-    start = get_time();
-    loop_not_vec(n, x, y, z, n_iter);
-    end = get_time();
-    printf("Loop 2 (likely not vectorizable) Val %e, Time %e\n", norm(n, z), end - start);
+    time_loop("Loop 2 (likely not vectorizable)", loop_not_vec, n, x, y, z);
         
 
     // Test Loop that might be vectorizable (can vectorize every 4 iterations)
-    reset_vectors(n, x, y, z);
-    start = get_time();
-    loop_maybe_vec(n, x, y, z, n_iter);
-    end = get_time();
-    printf("Loop 3 (maybe vectorizable) Val %e, Time %e\n", norm(n, z), end - start);
+    time_loop("Loop 3 (maybe vectorizable)", loop_maybe_vec, n, x, y, z);
 
 
     // Test Loop that might be vectorizable (can vectorize every 4 iterations)
-    reset_vectors(n, x, y, z);
-    start = get_time();
-    loop_unrolled(n, x, y, z, n_iter);
-    end = get_time();
-    printf("Loop 4 (loop 3, unrolled) Val %e, Time %e\n", norm(n, z), end - start);
+    time_loop("Loop 4 (loop 3, unrolled)", loop_unrolled, n, x, y, z);
 
 
     // What if we add a dependency (x[0] = z[1])
-    reset_vectors(n, x, y, z);
     free(z);
     z = &(x[1]);
-    start = get_time();
-    loop(n, x, y, z, n_iter);
-    end = get_time();
-    printf("Loop 1 with aliasing: Val %e, Time %e\n", norm(n, z), end - start);
+    time_loop("Loop 1 with aliasing:", loop, n, x, y, z);
 
 
 
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "timer.h"
+#include "benchmark.h"
+#include "roofline.h"
 #include <omp.h>
 
 // module load gcc/10.2.0-7uu2
@@ -276,6 +278,21 @@ double sum(int n, double* C)
     return s;
 }
 
+// Everything test_omp needs, so the benchmark harness can call it repeatedly
+typedef struct
+{
+    double* A;
+    double* B;
+    double* C;
+    int n;
+} matmat_args;
+
+void test_omp_kernel(void* data)
+{
+    matmat_args* args = (matmat_args*)data;
+    test_omp(args->n, args->A, args->B, args->C, 1);
+}
+
 // This program runs matrix matrix multiplication with single pointers
 // Test vectorization improvements for both doubles and floats
 int main(int argc, char* argv[])
@@ -307,11 +324,6 @@ int main(int argc, char* argv[])
     end = get_time();
     printf("Serial: Sum %e, Time Per MatMat %e\n", sum(n, C), (end - start)/n_iter);
 
-    start = get_time();
-    test_omp(n, A, B, C, n_iter);
-    end = get_time();
-    printf("CPU OMP: Sum %e, Time Per MatMat %e\n", sum(n, C), (end - start)/n_iter);
-
     start = get_time();
     test_omp_gpu(n, A, B, C, n_iter);
     end = get_time();
@@ -327,6 +339,20 @@ int main(int argc, char* argv[])
     end = get_time();
     printf("GPU OMP Data: Sum %e, Time Per MatMat %e\n", sum(n, C), (end - start) / n_iter);
 */
+    // CPU OMP, compared against the host's roofline
+    // 2n^3 flops, and at least A, B, and C must move to/from memory once
+    // Timed with the harness (warm-up, then the median), as in threads.c
+    matmat_args args = {A, B, C, n};
+    benchmark_config config = default_benchmark_config();
+    benchmark_stats stats;
+    run_benchmark(test_omp_kernel, NULL, &args, config, &stats);
+    printf("CPU OMP: Sum %e, Time Per MatMat %e\n", sum(n, C), stats.median);
+    roofline_machine machine;
+    measure_roofline(&machine);
+    roofline_kernel kernel = {"test_omp", 2.0*n*n*n, 3.0*n*n*sizeof(double), stats.median};
+    print_roofline(&machine, &kernel, 1);
+    write_roofline_csv("roofline.csv", &machine, &kernel, 1);
+
     start = get_time();
     test_omp_gpu_teams(n, A, B, C, n_iter);
     end = get_time();
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <omp.h>
 #include "../timer.h"
+#include "../benchmark.h"
+#include "../roofline.h"
+#include "../padded.h"
 
 
 void dot_product(double* A, double* B, double* C, int row, int col, int n)
@@ -65,9 +68,15 @@ void matmult_oor(double* A, double* B, double* C, int n)
     }
 }
 
+// Each thread's partial sum goes in its own cache line (see padded.h), and
+// the partial sums are added in thread order, so the result is the same
+// on every run with the same number of threads
 double sum(double* A, int n)
 {
-    double global_sum = 0;
+    per_thread_buffer partial;
+    if (per_thread_alloc(&partial, omp_get_max_threads(), sizeof(double), padded_line_size()) != 0)
+        return 0;
+    int n_threads = 1;
 #pragma omp parallel
 {
     double s = 0;
@@ -84,15 +93,39 @@ double sum(double* A, int n)
         }
     }
 
-#pragma omp critical
-    {
-        global_sum += s;
-    }
+    *PER_THREAD(&partial, double, thread_id) = s;
+#pragma omp single
+    n_threads = num_threads;
 }
 
+    double global_sum = 0;
+    for (int t = 0; t < n_threads; t++)
+        global_sum += *PER_THREAD(&partial, double, t);
+    per_thread_free(&partial);
     return global_sum;
 }
 
+// Everything matmult needs, so the benchmark harness can call it repeatedly
+typedef struct
+{
+    double* A;
+    double* B;
+    double* C;
+    int n;
+} matmult_args;
+
+void matmult_kernel(void* data)
+{
+    matmult_args* args = (matmult_args*)data;
+    matmult(args->A, args->B, args->C, args->n);
+}
+
+void matmult_oor_kernel(void* data)
+{
+    matmult_args* args = (matmult_args*)data;
+    matmult_oor(args->A, args->B, args->C, args->n);
+}
+
 int main(int argc, char* argv[])
 {
     // Get size of vectors : command line argument
@@ -103,7 +136,6 @@ int main(int argc, char* argv[])
     }
 
     int n = atoi(argv[1]);
-    int n_iter = 100;
     double* A = (double*)malloc(n*n*sizeof(double));
     double* B = (double*)malloc(n*n*sizeof(double));
     double* C = (double*)malloc(n*n*sizeof(double));
@@ -116,12 +148,26 @@ int main(int argc, char* argv[])
     }
 
     // Calculate C = A*B
-    /*matmult(A, B, C, n);
-    double t0 = get_time();
-    for (int i = 0; i < n_iter; i++)
-        matmult(A, B, C, n);
-    double tfinal = (get_time() - t0) / n_iter;
-    printf("Time to multiply two %dx%d matrices: %e\n", n, n, tfinal);*/
+    // Each multiply is timed many times, reporting the spread rather than one average
+    matmult_args args = {A, B, C, n};
+    benchmark_config config = default_benchmark_config();
+    config.max_samples = 100;
+    benchmark_stats stats;
+    run_benchmark(matmult_kernel, NULL, &args, config, &stats);
+    printf("Time to multiply two %dx%d matrices: %e\n", n, n, stats.median);
+    print_stats("Matmult", &stats);
+
+    run_benchmark(matmult_oor_kernel, NULL, &args, config, &stats);
+    printf("Time to multiply two %dx%d matrices (out of order): %e\n", n, n, stats.median);
+    print_stats("Matmult OOR", &stats);
+
+    // Compare the out of order matmult against the machine's roofline
+    // 2n^3 flops, and at least A, B, and C must move to/from memory once
+    roofline_machine machine;
+    measure_roofline(&machine);
+    roofline_kernel kernel = {"matmult_oor", 2.0*n*n*n, 3.0*n*n*sizeof(double), stats.median};
+    print_roofline(&machine, &kernel, 1);
+    write_roofline_csv("roofline.csv", &machine, &kernel, 1);
 
 
     hello_world();
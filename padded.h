@@ -0,0 +1,141 @@
+#ifndef PADDED_H
+#define PADDED_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "topology.h"
+
+// Per-thread data without false sharing
+// Two threads writing different variables in the same cache line still
+// bounce that line between their cores, so per-thread accumulators (partial
+// sums, counters, histograms) that sit next to each other in an array run
+// far slower than independent ones (see cache/false_sharing.c).  Giving each
+// thread its own cache line avoids this.
+//
+// In C, a per_thread_buffer holds one slot per thread, each slot rounded up
+// to (and aligned to) the larger of the cache line size detected at run time
+// and PADDED_LINE:
+//     per_thread_buffer sums;
+//     per_thread_alloc(&sums, omp_get_max_threads(), sizeof(double), padded_line_size());
+//     #pragma omp parallel
+//     *PER_THREAD(&sums, double, omp_get_thread_num()) += ...;
+//     ...
+//     per_thread_free(&sums);
+//
+// In C++, padded<T> is a T aligned to PADDED_LINE at compile time (so it can
+// live in arrays and structs), and per_thread<T> pads like per_thread_alloc:
+//     per_thread<double> sums(omp_get_max_threads());
+//     #pragma omp parallel
+//     sums[omp_get_thread_num()] += ...;
+//     double total = sums.reduce(0.0);
+
+// Compile-time line size for padded<T>
+// 128 covers both 128-byte lines (e.g. Apple M-series and POWER) and CPUs that
+// fetch pairs of 64-byte lines (the Intel spatial prefetcher).
+// Can be set on the compile line, e.g. -DPADDED_LINE=64
+#ifndef PADDED_LINE
+#define PADDED_LINE 128
+#endif
+
+// Detected L1 line size, read once
+long padded_line_size()
+{
+    static long line_size = 0;
+    if (line_size == 0)
+    {
+        cache_topology topo;
+        detect_cache_topology(&topo);
+        line_size = topo.line_size;
+    }
+    return line_size;
+}
+
+typedef struct
+{
+    char* data;
+    size_t stride;      // Bytes between slots, a multiple of the padding
+    int n;
+} per_thread_buffer;
+
+#define PER_THREAD(buf, type, i) ((type*)((buf)->data + (size_t)(i) * (buf)->stride))
+
+// n zeroed slots of elem_size bytes, each starting on its own line
+// Slots are padded to at least PADDED_LINE, even when the detected line is
+// smaller, so that adjacent-line prefetch pairs are not shared either
+// Returns 0 on success, -1 if the allocation failed
+int per_thread_alloc(per_thread_buffer* buf, int n, size_t elem_size, long line_size)
+{
+    long pad = line_size > PADDED_LINE ? line_size : PADDED_LINE;
+    buf->n = n;
+    buf->stride = (elem_size + pad - 1) / pad * pad;
+    if (posix_memalign((void**)&buf->data, pad, n * buf->stride) != 0)
+    {
+        buf->data = NULL;
+        fprintf(stderr, "padded.h : could not allocate %d slots of %zu bytes\n", n, buf->stride);
+        return -1;
+    }
+    memset(buf->data, 0, n * buf->stride);
+    return 0;
+}
+
+void per_thread_free(per_thread_buffer* buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+}
+
+#ifdef __cplusplus
+#include <new>
+
+template <typename T>
+struct alignas(PADDED_LINE) padded
+{
+    T value;
+
+    padded() : value() {}
+    padded(const T& v) : value(v) {}
+    operator T&() { return value; }
+    operator const T&() const { return value; }
+};
+
+template <typename T>
+class per_thread
+{
+  public:
+    per_thread(int n, long line_size = padded_line_size())
+    {
+        if (per_thread_alloc(&buf, n, sizeof(T), line_size < (long)alignof(T) ? alignof(T) : line_size) != 0)
+            buf.n = 0;
+        for (int i = 0; i < buf.n; i++)
+            new (PER_THREAD(&buf, T, i)) T();
+    }
+
+    ~per_thread()
+    {
+        for (int i = 0; i < buf.n; i++)
+            PER_THREAD(&buf, T, i)->~T();
+        per_thread_free(&buf);
+    }
+
+    per_thread(const per_thread&) = delete;
+    per_thread& operator=(const per_thread&) = delete;
+
+    T& operator[](int i) { return *PER_THREAD(&buf, T, i); }
+    const T& operator[](int i) const { return *PER_THREAD(&buf, T, i); }
+    int size() const { return buf.n; }
+
+    // Sum of every thread's slot
+    T reduce(T init) const
+    {
+        for (int i = 0; i < buf.n; i++)
+            init += (*this)[i];
+        return init;
+    }
+
+  private:
+    per_thread_buffer buf;
+};
+#endif
+
+#endif
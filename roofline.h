@@ -0,0 +1,191 @@
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "benchmark.h"
+
+// Roofline reporter
+// Measures the machine's peak memory bandwidth (STREAM Triad, as in
+// cache/stream.c) and peak flop rate (independent FMA chains), then for each
+// kernel reports arithmetic intensity, attained GFLOP/s, and percent of the
+// roofline min(peak flops, intensity * peak bandwidth).
+//
+// Usage :
+//     roofline_machine machine;
+//     measure_roofline(&machine);
+//     roofline_kernel kernels[1] = {{"matmat", 2.0*n*n*n, 3.0*n*n*sizeof(double), seconds}};
+//     print_roofline(&machine, kernels, 1);
+//     write_roofline_csv("roofline.csv", &machine, kernels, 1);
+//
+// Peak flops need vectorized FMAs, and peak bandwidth needs every core:
+//     gcc -O3 -march=native -fopenmp ...
+
+// Doubles per Triad array (default 3 x 64 MB, well beyond last-level cache)
+#ifndef ROOFLINE_STREAM_SIZE
+#define ROOFLINE_STREAM_SIZE (1L << 23)
+#endif
+
+// Independent FMA chains per thread, enough to hide FMA latency on
+// two FMA units with 512-bit vectors
+#ifndef ROOFLINE_FMA_CHAINS
+#define ROOFLINE_FMA_CHAINS 64
+#endif
+
+typedef struct
+{
+    double peak_gbs;        // GB/s, STREAM Triad
+    double peak_gflops;     // GFLOP/s, FMA microbenchmark
+    int n_threads;
+} roofline_machine;
+
+typedef struct
+{
+    const char* name;
+    double flops;       // Floating point operations per call
+    double bytes;       // Bytes moved to/from memory per call
+    double seconds;     // Time per call
+} roofline_kernel;
+
+typedef struct
+{
+    double* a;
+    double* b;
+    double* c;
+    long n;
+} roofline_triad_args;
+
+void roofline_triad(void* data)
+{
+    roofline_triad_args* args = (roofline_triad_args*)data;
+    double scalar = 3.0;
+#pragma omp parallel for
+    for (long j = 0; j < args->n; j++)
+        args->a[j] = args->b[j] + scalar*args->c[j];
+}
+
+// Each iteration does ROOFLINE_FMA_CHAINS independent FMAs per thread
+// x < 1 and y small keep the values bounded (and away from denormals)
+void roofline_fma(void* data, long n_iter)
+{
+    double* result = (double*)data;
+    double total = 0;
+#pragma omp parallel reduction(+:total)
+    {
+        double acc[ROOFLINE_FMA_CHAINS];
+        double x = 0.999999;
+        double y = 1e-6;
+        for (int k = 0; k < ROOFLINE_FMA_CHAINS; k++)
+            acc[k] = 1.0 + k*1e-3;
+        for (long i = 0; i < n_iter; i++)
+        {
+#pragma omp simd
+            for (int k = 0; k < ROOFLINE_FMA_CHAINS; k++)
+                acc[k] = acc[k]*x + y;
+        }
+        for (int k = 0; k < ROOFLINE_FMA_CHAINS; k++)
+            total += acc[k];
+    }
+    *result = total;
+}
+
+int roofline_num_threads()
+{
+    int n_threads = 0;
+#pragma omp parallel reduction(+:n_threads)
+    n_threads += 1;
+    return n_threads;
+}
+
+// Measure peak bandwidth and peak flops, using the best of many runs
+void measure_roofline(roofline_machine* machine)
+{
+    benchmark_config config = default_benchmark_config();
+    benchmark_stats stats;
+
+    machine->n_threads = roofline_num_threads();
+
+    roofline_triad_args args;
+    args.n = ROOFLINE_STREAM_SIZE;
+    args.a = (double*)malloc(args.n*sizeof(double));
+    args.b = (double*)malloc(args.n*sizeof(double));
+    args.c = (double*)malloc(args.n*sizeof(double));
+    // Parallel first touch, matching the kernel's schedule
+#pragma omp parallel for
+    for (long j = 0; j < args.n; j++)
+    {
+        args.a[j] = 1.0;
+        args.b[j] = 2.0;
+        args.c[j] = 0.0;
+    }
+    config.max_samples = 20;
+    run_benchmark(roofline_triad, NULL, &args, config, &stats);
+    machine->peak_gbs = get_grate(get_rate(stats.min, 3 * sizeof(double) * args.n));
+    free(args.a);
+    free(args.b);
+    free(args.c);
+
+    double result;
+    config.max_samples = 10;
+    run_benchmark_calibrated(roofline_fma, NULL, &result, config, &stats);
+    machine->peak_gflops = 2.0 * ROOFLINE_FMA_CHAINS * machine->n_threads / stats.min * 1e-9;
+}
+
+double roofline_intensity(roofline_kernel* k)
+{
+    return k->flops / k->bytes;
+}
+
+double roofline_attained(roofline_kernel* k)
+{
+    return k->flops / k->seconds * 1e-9;
+}
+
+// The roofline at a kernel's arithmetic intensity
+double roofline_bound(roofline_machine* machine, roofline_kernel* k)
+{
+    double memory_bound = roofline_intensity(k) * machine->peak_gbs;
+    return memory_bound < machine->peak_gflops ? memory_bound : machine->peak_gflops;
+}
+
+void print_roofline(roofline_machine* machine, roofline_kernel* kernels, int n_kernels)
+{
+    printf("Roofline: Peak Bandwidth %.2f GB/s, Peak %.2f GFLOP/s, %d Threads, Ridge Point %.2f FLOP/Byte\n",
+            machine->peak_gbs, machine->peak_gflops, machine->n_threads,
+            machine->peak_gflops / machine->peak_gbs);
+    printf("%-24s %12s %12s %12s %12s %10s\n", "Kernel", "FLOP/Byte",
+            "GFLOP/s", "Roof", "Bound", "% Roof");
+    for (int i = 0; i < n_kernels; i++)
+    {
+        roofline_kernel* k = &kernels[i];
+        double bound = roofline_bound(machine, k);
+        int memory_bound = roofline_intensity(k) * machine->peak_gbs < machine->peak_gflops;
+        printf("%-24s %12.3f %12.3f %12.3f %12s %9.2f%%\n", k->name,
+                roofline_intensity(k), roofline_attained(k), bound,
+                memory_bound ? "memory" : "compute", 100.0 * roofline_attained(k) / bound);
+    }
+}
+
+// Write the machine peaks and one row per kernel, for plotting
+void write_roofline_csv(const char* filename, roofline_machine* machine,
+        roofline_kernel* kernels, int n_kernels)
+{
+    FILE* f = fopen(filename, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "roofline.h : could not open %s\n", filename);
+        return;
+    }
+    fprintf(f, "kernel,flops,bytes,seconds,intensity,gflops,roof_gflops,percent_roof,peak_gbs,peak_gflops\n");
+    for (int i = 0; i < n_kernels; i++)
+    {
+        roofline_kernel* k = &kernels[i];
+        double bound = roofline_bound(machine, k);
+        fprintf(f, "%s,%e,%e,%e,%e,%e,%e,%e,%e,%e\n", k->name, k->flops, k->bytes,
+                k->seconds, roofline_intensity(k), roofline_attained(k), bound,
+                100.0 * roofline_attained(k) / bound, machine->peak_gbs, machine->peak_gflops);
+    }
+    fclose(f);
+}
+
+#endif
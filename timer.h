@@ -1,6 +1,119 @@
+#ifndef TIMER_H
+#define TIMER_H
+
 #include <unistd.h>
+#include <time.h>
 #include <sys/time.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// The timing backend is selected at compile time:
+//     (default)              : clock_gettime(CLOCK_MONOTONIC_RAW)
+//                              nanosecond resolution, never adjusted by NTP
+//     -DTIMER_TSC            : invariant cycle counter (rdtsc on x86, cntvct_el0 on ARM)
+//                              calibrated once against CLOCK_MONOTONIC_RAW
+//     -DTIMER_GETTIMEOFDAY   : the original gettimeofday timer (microseconds, not monotonic)
+// E.g. gcc -O2 -DTIMER_TSC -o cacheline cacheline.c
+//
+// All backends return seconds as a double, so get_seconds, get_rate and
+// get_grate work the same way with each of them.
+
+#if defined(TIMER_TSC) && !defined(__x86_64__) && !defined(__i386__) && !defined(__aarch64__)
+#warning "TIMER_TSC is only supported on x86 and aarch64, using clock_gettime instead"
+#undef TIMER_TSC
+#endif
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+// Returns seconds from the raw monotonic clock
+double get_monotonic_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+#ifdef TIMER_TSC
+
+// Read the cycle counter
+// On x86, lfence before rdtsc keeps earlier instructions from drifting into
+// the timed region, and lfence after keeps later ones from starting before it.
+// On ARM, isb serializes the instruction stream around the counter read.
+uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+#else
+    uint64_t val;
+    __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(val) :: "memory");
+    return val;
+#endif
+}
+
+// Returns 1 if the cycle counter ticks at a constant rate, regardless of
+// frequency scaling and sleep states (CPUID leaf 0x80000007, EDX bit 8)
+int cycles_invariant()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000000));
+    if (eax < 0x80000007)
+        return 0;
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000007));
+    return (edx >> 8) & 1;
+#else
+    // The ARM generic timer is architecturally constant-rate
+    return 1;
+#endif
+}
+
+static uint64_t timer_cycle_base = 0;
+static double timer_seconds_per_cycle = 0;
+
+// Measure cycles per second against CLOCK_MONOTONIC_RAW
+// Called once, the first time get_time() is used
+void calibrate_cycles()
+{
+#if defined(__aarch64__)
+    uint64_t freq;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+    timer_seconds_per_cycle = 1.0 / freq;
+#else
+    if (!cycles_invariant())
+        fprintf(stderr, "timer.h : TSC is not invariant, timings may be affected by frequency scaling\n");
+
+    // Best of several 10ms windows, to ignore a window that was interrupted
+    double best = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        double t0 = get_monotonic_time();
+        uint64_t c0 = read_cycles();
+        while (get_monotonic_time() - t0 < 0.01);
+        uint64_t c1 = read_cycles();
+        double t1 = get_monotonic_time();
+        double spc = (t1 - t0) / (double)(c1 - c0);
+        if (best == 0 || spc < best)
+            best = spc;
+    }
+    timer_seconds_per_cycle = best;
+#endif
+    timer_cycle_base = read_cycles();
+}
+
+// Returns the current time, in seconds since the counter was calibrated
+double get_time()
+{
+    if (timer_seconds_per_cycle == 0)
+        calibrate_cycles();
+    return (double)(read_cycles() - timer_cycle_base) * timer_seconds_per_cycle;
+}
+
+#elif defined(TIMER_GETTIMEOFDAY)
 
 // Returns the current time of the day
 double get_time()
@@ -10,7 +123,29 @@ double get_time()
     return (double)timecheck.tv_sec + (double)timecheck.tv_usec*1e-6;
 }
 
-// Returns the elapsed time between the start time of the day and end time of the day
+#else
+
+// Returns the current time from the raw monotonic clock
+double get_time()
+{
+    return get_monotonic_time();
+}
+
+#endif
+
+// Returns a name for the selected backend (useful when printing results)
+const char* get_timer_name()
+{
+#if defined(TIMER_TSC)
+    return "cycle counter";
+#elif defined(TIMER_GETTIMEOFDAY)
+    return "gettimeofday";
+#else
+    return "clock_gettime(CLOCK_MONOTONIC_RAW)";
+#endif
+}
+
+// Returns the elapsed time between the start time and end time
 // Does not ignore OS operations
 // Also measures any threads that interrupt (or idle time) in a parallel setting
 double get_seconds(double start, double end)
@@ -31,3 +166,355 @@ double get_grate(double rate)
 {
     return rate * 1e-9;
 }
+
+// Latency histogram
+// Averages hide the tail, so record every iteration's time in a fixed-size,
+// log-bucketed histogram (as in HdrHistogram).  Values are nanoseconds;
+// below 2^HISTOGRAM_SUB_BITS each nanosecond has its own bucket, and above
+// that every power of two is split into 2^(HISTOGRAM_SUB_BITS-1) buckets,
+// so a value is known to within about 3% (with the default of 6 bits).
+// Recording is a few integer operations, and histograms from different
+// threads or files can be merged by adding counts (see also
+// reduce_histogram in mpi_timer.h for MPI ranks).
+//
+// Usage :
+//     latency_histogram hist;
+//     histogram_init(&hist);
+//     for (...)
+//     {
+//         double start = get_time();
+//         ... iteration ...
+//         histogram_record(&hist, get_seconds(start, get_time()));
+//     }
+//     print_histogram("Iteration", &hist);
+//     write_histogram("iteration.hist", &hist);
+
+#ifndef HISTOGRAM_SUB_BITS
+#define HISTOGRAM_SUB_BITS 6
+#endif
+
+// Largest recordable value is 2^HISTOGRAM_MAX_BITS ns (about 5 hours),
+// larger values are counted in the last bucket
+#ifndef HISTOGRAM_MAX_BITS
+#define HISTOGRAM_MAX_BITS 44
+#endif
+
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_HALF_COUNT (HISTOGRAM_SUB_COUNT / 2)
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) * HISTOGRAM_HALF_COUNT)
+
+typedef struct
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t min_ns, max_ns;    // Exact extremes
+    double sum;                 // Seconds, for the mean
+} latency_histogram;
+
+void histogram_init(latency_histogram* hist)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        hist->counts[i] = 0;
+    hist->total = 0;
+    hist->min_ns = UINT64_MAX;
+    hist->max_ns = 0;
+    hist->sum = 0;
+}
+
+int histogram_msb(uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int msb = 0;
+    while (value >>= 1) msb++;
+    return msb;
+#endif
+}
+
+int histogram_index(uint64_t ns)
+{
+    if (ns < HISTOGRAM_SUB_COUNT)
+        return (int)ns;
+    int shift = histogram_msb(ns) - HISTOGRAM_SUB_BITS + 1;
+    int index = shift * HISTOGRAM_HALF_COUNT + (int)(ns >> shift);
+    return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+// Smallest value (ns) that falls in bucket index
+uint64_t histogram_bucket_start(int index)
+{
+    if (index < HISTOGRAM_SUB_COUNT)
+        return index;
+    int shift = index / HISTOGRAM_HALF_COUNT - 1;
+    uint64_t mantissa = index - shift * HISTOGRAM_HALF_COUNT;
+    return mantissa << shift;
+}
+
+void histogram_record(latency_histogram* hist, double seconds)
+{
+    uint64_t ns = seconds > 0 ? (uint64_t)(seconds * 1e9 + 0.5) : 0;
+    hist->counts[histogram_index(ns)]++;
+    hist->total++;
+    if (ns < hist->min_ns) hist->min_ns = ns;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+    hist->sum += seconds;
+}
+
+// Add the counts of src into dst
+void histogram_merge(latency_histogram* dst, const latency_histogram* src)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    if (src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+    dst->sum += src->sum;
+}
+
+// Returns the p-th percentile (0 < p <= 100) in seconds, reporting the top
+// of the bucket (capped at the exact max) so tails are never understated
+double histogram_percentile(const latency_histogram* hist, double p)
+{
+    if (hist->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * hist->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->total) rank = hist->total;
+
+    uint64_t count = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        count += hist->counts[i];
+        if (count >= rank)
+        {
+            uint64_t top = histogram_bucket_start(i + 1) - 1;
+            if (top > hist->max_ns) top = hist->max_ns;
+            if (top < hist->min_ns) top = hist->min_ns;
+            return top * 1e-9;
+        }
+    }
+    return hist->max_ns * 1e-9;
+}
+
+void print_histogram(const char* label, const latency_histogram* hist)
+{
+    if (hist->total == 0)
+    {
+        printf("%s: no samples\n", label);
+        return;
+    }
+    printf("%s: n %llu, Mean %e, P50 %e, P99 %e, P99.9 %e, Max %e\n",
+            label, (unsigned long long)hist->total, hist->sum / hist->total,
+            histogram_percentile(hist, 50), histogram_percentile(hist, 99),
+            histogram_percentile(hist, 99.9), hist->max_ns * 1e-9);
+}
+
+// Text format: a header line, then "bucket_start_ns count" for each nonempty
+// bucket, so files can be inspected, plotted, or read back and merged
+int write_histogram(const char* filename, const latency_histogram* hist)
+{
+    FILE* f = fopen(filename, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "timer.h : could not open %s\n", filename);
+        return -1;
+    }
+    fprintf(f, "latency_histogram %d %d %llu %llu %llu %.17g\n",
+            HISTOGRAM_SUB_BITS, HISTOGRAM_MAX_BITS, (unsigned long long)hist->total,
+            (unsigned long long)hist->min_ns, (unsigned long long)hist->max_ns, hist->sum);
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        if (hist->counts[i])
+            fprintf(f, "%llu %llu\n", (unsigned long long)histogram_bucket_start(i),
+                    (unsigned long long)hist->counts[i]);
+    fclose(f);
+    return 0;
+}
+
+// Read a histogram written by write_histogram (with the same bucket layout)
+int read_histogram(const char* filename, latency_histogram* hist)
+{
+    FILE* f = fopen(filename, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "timer.h : could not open %s\n", filename);
+        return -1;
+    }
+    int sub_bits, max_bits;
+    unsigned long long total, min_ns, max_ns, start, count;
+    histogram_init(hist);
+    if (fscanf(f, "latency_histogram %d %d %llu %llu %llu %lg", &sub_bits, &max_bits,
+                &total, &min_ns, &max_ns, &hist->sum) != 6
+            || sub_bits != HISTOGRAM_SUB_BITS || max_bits != HISTOGRAM_MAX_BITS)
+    {
+        fprintf(stderr, "timer.h : %s is not a compatible histogram\n", filename);
+        fclose(f);
+        return -1;
+    }
+    hist->total = total;
+    hist->min_ns = min_ns;
+    hist->max_ns = max_ns;
+    while (fscanf(f, "%llu %llu", &start, &count) == 2)
+        hist->counts[histogram_index(start)] += count;
+    fclose(f);
+    return 0;
+}
+
+// Energy probe (Linux powercap RAPL)
+// Reads the package and DRAM energy counters in
+// /sys/class/powercap/intel-rapl* (also used on AMD) around a timed region.
+// The counters are in microjoules and wrap at max_energy_range_uj, so one
+// wrap per region is corrected (regions must stay shorter than the wrap
+// period, typically a minute or more per package).  Counters update about
+// every millisecond, so regions should be much longer than that.
+// If the files are missing (not Linux, not Intel/AMD, a VM) or unreadable
+// (newer kernels restrict energy_uj to root), no domains are found and
+// print_energy prints nothing.
+//
+// Usage :
+//     energy_probe energy;
+//     energy_init(&energy);
+//     double start = get_time();
+//     energy_start(&energy);
+//     ... region ...
+//     energy_stop(&energy);
+//     double seconds = get_seconds(start, get_time());
+//     print_energy("Triad", &energy, seconds, gbytes, "GB");
+
+#define ENERGY_MAX_DOMAINS 16
+
+// Can be pointed elsewhere on the compile line, e.g. for a copy of sysfs
+#ifndef ENERGY_POWERCAP_DIR
+#define ENERGY_POWERCAP_DIR "/sys/class/powercap"
+#endif
+
+typedef struct
+{
+    int n_domains;
+    char name[ENERGY_MAX_DOMAINS][32];      // e.g. package-0, dram
+    char path[ENERGY_MAX_DOMAINS][96];      // energy_uj file
+    int dram[ENERGY_MAX_DOMAINS];           // 1 for DRAM domains, 0 for packages
+    uint64_t max_range[ENERGY_MAX_DOMAINS]; // Wraparound value, in uJ
+    uint64_t start[ENERGY_MAX_DOMAINS];
+    double joules[ENERGY_MAX_DOMAINS];      // Accumulated over start/stop pairs
+} energy_probe;
+
+// Reads one unsigned integer from a sysfs file, returning -1 on failure
+int energy_read_file(const char* path, uint64_t* value)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    unsigned long long v;
+    int ok = fscanf(f, "%llu", &v) == 1;
+    fclose(f);
+    if (!ok)
+        return -1;
+    *value = v;
+    return 0;
+}
+
+// Adds the zone in dir if it is a package or DRAM domain with a readable counter
+void energy_add_domain(energy_probe* energy, const char* dir)
+{
+    char path[128];
+    char name[32];
+    uint64_t value;
+
+    if (energy->n_domains >= ENERGY_MAX_DOMAINS)
+        return;
+    snprintf(path, sizeof(path), "%s/name", dir);
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return;
+    int ok = fscanf(f, "%31s", name) == 1;
+    fclose(f);
+    if (!ok)
+        return;
+
+    int dram = strcmp(name, "dram") == 0;
+    if (!dram && strncmp(name, "package", 7) != 0)
+        return;
+
+    int d = energy->n_domains;
+    snprintf(energy->path[d], sizeof(energy->path[d]), "%s/energy_uj", dir);
+    snprintf(path, sizeof(path), "%s/max_energy_range_uj", dir);
+    if (energy_read_file(energy->path[d], &value) != 0
+            || energy_read_file(path, &energy->max_range[d]) != 0)
+        return;
+    snprintf(energy->name[d], sizeof(energy->name[d]), "%s", name);
+    energy->dram[d] = dram;
+    energy->joules[d] = 0;
+    energy->n_domains++;
+}
+
+// Finds the package (intel-rapl:N) and DRAM (intel-rapl:N:M) domains
+// Returns the number of domains found
+int energy_init(energy_probe* energy)
+{
+    char dir[80];
+    energy->n_domains = 0;
+    for (int pkg = 0; pkg < ENERGY_MAX_DOMAINS; pkg++)
+    {
+        snprintf(dir, sizeof(dir), ENERGY_POWERCAP_DIR "/intel-rapl:%d", pkg);
+        energy_add_domain(energy, dir);
+        for (int sub = 0; sub < ENERGY_MAX_DOMAINS; sub++)
+        {
+            snprintf(dir, sizeof(dir), ENERGY_POWERCAP_DIR "/intel-rapl:%d:%d", pkg, sub);
+            energy_add_domain(energy, dir);
+        }
+    }
+    if (energy->n_domains == 0)
+        printf("Note: RAPL energy counters not available, energy is not reported\n");
+    return energy->n_domains;
+}
+
+void energy_reset(energy_probe* energy)
+{
+    for (int d = 0; d < energy->n_domains; d++)
+        energy->joules[d] = 0;
+}
+
+void energy_start(energy_probe* energy)
+{
+    for (int d = 0; d < energy->n_domains; d++)
+        energy_read_file(energy->path[d], &energy->start[d]);
+}
+
+void energy_stop(energy_probe* energy)
+{
+    for (int d = 0; d < energy->n_domains; d++)
+    {
+        uint64_t end = energy->start[d];
+        energy_read_file(energy->path[d], &end);
+        uint64_t delta = end >= energy->start[d] ? end - energy->start[d]
+            : end + energy->max_range[d] - energy->start[d];
+        energy->joules[d] += delta * 1e-6;
+    }
+}
+
+// Joules summed over package (dram = 0) or DRAM (dram = 1) domains
+double energy_joules(energy_probe* energy, int dram)
+{
+    double joules = 0;
+    for (int d = 0; d < energy->n_domains; d++)
+        if (energy->dram[d] == dram)
+            joules += energy->joules[d];
+    return joules;
+}
+
+// Prints package and DRAM joules, average watts, and work (e.g. GB or GFLOP,
+// named by unit) per joule of package + DRAM energy
+void print_energy(const char* label, energy_probe* energy, double seconds,
+        double work, const char* unit)
+{
+    if (energy->n_domains == 0)
+        return;
+    double package = energy_joules(energy, 0);
+    double dram = energy_joules(energy, 1);
+    double total = package + dram;
+    printf("%s: Package %e J, DRAM %e J, Power %.2f W, %e %s/J\n", label,
+            package, dram, total / seconds, total > 0 ? work / total : 0, unit);
+}
+
+#endif
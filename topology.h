@@ -0,0 +1,449 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "timer.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+// Cache hierarchy detection
+// Working sets and tile sizes should come from the machine the code runs on,
+// not from hard-coded sizes (a 128-byte line and 4 MB L2 on one machine are
+// a 64-byte line and 1 MB L2 on the next).  Sizes are read from
+//     1. /sys/devices/system/cpu/cpu0/cache/index*   (Linux)
+//     2. sysconf(_SC_LEVEL1_DCACHE_SIZE, ...)         (glibc)
+//     3. defaults (64-byte lines, 32 KB L1, 1 MB L2, 8 MB L3)
+// and can be cross-checked with a pointer-chasing latency sweep, since
+// latency should step up just past each cache size.
+//
+// Usage :
+//     cache_topology topo;
+//     detect_cache_topology(&topo);
+//     print_cache_topology(&topo);
+//     verify_cache_topology(&topo);    // optional, takes a few seconds
+//     long l2_bytes = cache_size(&topo, 2);
+
+#define TOPOLOGY_MAX_LEVEL 4
+
+typedef struct
+{
+    long line_size;                         // Bytes, of the L1 data cache
+    long size[TOPOLOGY_MAX_LEVEL + 1];      // Bytes per data/unified cache, by level (0 if none)
+    int n_levels;                           // Deepest level found
+    const char* source;                     // Where the sizes came from
+} cache_topology;
+
+// Parses sysfs sizes such as "48K" or "32M"
+long topology_parse_size(const char* str)
+{
+    char* end;
+    long size = strtol(str, &end, 10);
+    if (*end == 'K' || *end == 'k') size *= 1024;
+    else if (*end == 'M' || *end == 'm') size *= 1024 * 1024;
+    else if (*end == 'G' || *end == 'g') size *= 1024L * 1024 * 1024;
+    return size;
+}
+
+// Reads the first line of a sysfs file into buf, returning -1 on failure
+int topology_read_line(const char* path, char* buf, int len)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    char* ok = fgets(buf, len, f);
+    fclose(f);
+    if (ok == NULL)
+        return -1;
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// Returns 0 if at least the L1 data cache was found
+int read_cache_sysfs(cache_topology* topo)
+{
+    char path[128];
+    char buf[64];
+    for (int index = 0; index < 16; index++)
+    {
+        const char* dir = "/sys/devices/system/cpu/cpu0/cache";
+        snprintf(path, sizeof(path), "%s/index%d/type", dir, index);
+        if (topology_read_line(path, buf, sizeof(buf)) != 0)
+            break;
+        if (strcmp(buf, "Instruction") == 0)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/index%d/level", dir, index);
+        if (topology_read_line(path, buf, sizeof(buf)) != 0)
+            continue;
+        int level = atoi(buf);
+        if (level < 1 || level > TOPOLOGY_MAX_LEVEL)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/index%d/size", dir, index);
+        if (topology_read_line(path, buf, sizeof(buf)) != 0)
+            continue;
+        topo->size[level] = topology_parse_size(buf);
+
+        if (level == 1)
+        {
+            snprintf(path, sizeof(path), "%s/index%d/coherency_line_size", dir, index);
+            if (topology_read_line(path, buf, sizeof(buf)) == 0)
+                topo->line_size = atol(buf);
+        }
+    }
+    return topo->size[1] > 0 ? 0 : -1;
+}
+
+// Returns 0 if at least the L1 data cache was found
+int read_cache_sysconf(cache_topology* topo)
+{
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    long sizes[4] = {0, sysconf(_SC_LEVEL1_DCACHE_SIZE),
+        sysconf(_SC_LEVEL2_CACHE_SIZE), sysconf(_SC_LEVEL3_CACHE_SIZE)};
+    for (int level = 1; level < 4; level++)
+        if (sizes[level] > 0)
+            topo->size[level] = sizes[level];
+    long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (line > 0)
+        topo->line_size = line;
+#endif
+    return topo->size[1] > 0 ? 0 : -1;
+}
+
+void detect_cache_topology(cache_topology* topo)
+{
+    topo->line_size = 0;
+    for (int level = 0; level <= TOPOLOGY_MAX_LEVEL; level++)
+        topo->size[level] = 0;
+
+    if (read_cache_sysfs(topo) == 0)
+        topo->source = "sysfs";
+    else if (read_cache_sysconf(topo) == 0)
+        topo->source = "sysconf";
+    else
+    {
+        topo->source = "defaults";
+        topo->size[1] = 32 * 1024;
+        topo->size[2] = 1024 * 1024;
+        topo->size[3] = 8 * 1024 * 1024;
+    }
+    if (topo->line_size <= 0)
+        topo->line_size = 64;
+
+    topo->n_levels = 0;
+    for (int level = 1; level <= TOPOLOGY_MAX_LEVEL; level++)
+        if (topo->size[level] > 0)
+            topo->n_levels = level;
+}
+
+// Size in bytes of the cache at level (1, 2, ...), or 0 if there is none
+long cache_size(cache_topology* topo, int level)
+{
+    if (level < 1 || level > TOPOLOGY_MAX_LEVEL)
+        return 0;
+    return topo->size[level];
+}
+
+// Size in bytes of the largest (last-level) cache
+long last_level_cache_size(cache_topology* topo)
+{
+    return topo->size[topo->n_levels];
+}
+
+void print_cache_topology(cache_topology* topo)
+{
+    printf("Cache Topology (%s): Line %ld bytes", topo->source, topo->line_size);
+    for (int level = 1; level <= topo->n_levels; level++)
+        if (topo->size[level] > 0)
+            printf(", L%d %ld KiB", level, topo->size[level] / 1024);
+    printf("\n");
+}
+
+
+// Pointer chasing (see cache/pointer_chase.c)
+// Each cache line holds a pointer to the next, in a single random cycle,
+// so every load depends on the previous one and misses cannot overlap
+
+// xorshift64*, since rand() only covers 2^31 values on some systems
+uint64_t chase_random(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ULL;
+}
+
+// Seed for chase_random, different on every run (xorshift needs a nonzero state)
+uint64_t chase_seed()
+{
+    return 88172645463325252ULL ^ (uint64_t)time(NULL);
+}
+
+// Link the n_lines lines (of line_size bytes) of buf into one random cycle
+// Sattolo's algorithm shuffles the visit order so that it is a single cycle
+// through every line (a plain shuffle would leave short cycles)
+void build_cycle(char* buf, long n_lines, long line_size, uint64_t* state)
+{
+    long* order = (long*)malloc(n_lines*sizeof(long));
+    for (long i = 0; i < n_lines; i++)
+        order[i] = i;
+    for (long i = n_lines - 1; i > 0; i--)
+    {
+        long j = chase_random(state) % i;
+        long tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (long i = 0; i < n_lines; i++)
+    {
+        long next = order[(i + 1) % n_lines];
+        *(void**)(buf + order[i]*line_size) = buf + next*line_size;
+    }
+    free(order);
+}
+
+// Follow n_loads pointers from start, returning where the chase ended
+void** chase_pointers(void** start, long n_loads)
+{
+    void** p = start;
+    for (long i = 0; i < n_loads; i++)
+        p = (void**)*p;
+    return p;
+}
+
+// Best-of-3 nanoseconds per dependent load, with a working set of bytes
+double chase_latency(char* buf, long bytes, long line_size, uint64_t* state)
+{
+    long n_loads = 1L << 21;
+    build_cycle(buf, bytes / line_size, line_size, state);
+    void** p = chase_pointers((void**)buf, bytes / line_size);  // Warm up
+    double best = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        double start = get_time();
+        p = chase_pointers(p, n_loads);
+        double seconds = get_seconds(start, get_time());
+        if (i == 0 || seconds < best)
+            best = seconds;
+    }
+    if (p == NULL)
+        printf("Chase ended on NULL\n");
+    return best / n_loads * 1e9;
+}
+
+// Cross-check each detected cache size: latency with a working set of twice
+// the cache should be clearly higher than with half of it
+// Returns the number of levels that show no latency step
+int verify_cache_topology(cache_topology* topo)
+{
+    long max_bytes = 2 * last_level_cache_size(topo);
+    char* buf = NULL;
+    if (posix_memalign((void**)&buf, topo->line_size, max_bytes) != 0)
+        return -1;
+
+    uint64_t state = 88172645463325252ULL;
+    int n_mismatch = 0;
+    for (int level = 1; level <= topo->n_levels; level++)
+    {
+        long size = topo->size[level];
+        if (size == 0)
+            continue;
+        double inside = chase_latency(buf, size / 2, topo->line_size, &state);
+        double outside = chase_latency(buf, 2 * size, topo->line_size, &state);
+        int ok = outside > 1.3 * inside;
+        if (!ok) n_mismatch++;
+        printf("L%d %ld KiB: %.2f ns/load at %ld KiB, %.2f ns/load at %ld KiB%s\n",
+                level, size / 1024, inside, size / 2048, outside, size / 512,
+                ok ? "" : "  (no latency step, size may be wrong)");
+    }
+    free(buf);
+    return n_mismatch;
+}
+
+
+// NUMA topology
+// Nodes and their CPUs are read from /sys/devices/system/node/node*/cpulist
+// (a machine without that directory is one node holding every CPU).
+// Threads are bound with sched_setaffinity, and memory with the mbind system
+// call, so libnuma is not needed.  Binding needs CPU_SET, which glibc only
+// defines with _GNU_SOURCE (define it before any include, or compile with g++).
+//
+// Usage :
+//     numa_topology numa;
+//     detect_numa_topology(&numa);
+//     bind_memory_to_node(ptr, bytes, 1);   // before the first touch
+//     #pragma omp parallel
+//     bind_thread_to_node(&numa, 0);
+
+#define TOPOLOGY_MAX_CPUS 1024
+#define TOPOLOGY_MAX_NODES 64
+
+typedef struct
+{
+    int n_nodes;                                // Highest node id + 1
+    int online[TOPOLOGY_MAX_NODES];             // 1 for nodes that exist (ids can have gaps)
+    int n_cpus;                                 // Highest CPU id + 1
+    int node_of_cpu[TOPOLOGY_MAX_CPUS];         // -1 for CPUs that are not online
+    int cpus_per_node[TOPOLOGY_MAX_NODES];
+} numa_topology;
+
+// Marks every CPU in a list such as "0-3,8-11" as belonging to node
+void topology_parse_cpulist(numa_topology* numa, const char* list, int node)
+{
+    const char* p = list;
+    while (*p)
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < TOPOLOGY_MAX_CPUS; cpu++)
+        {
+            numa->node_of_cpu[cpu] = node;
+            numa->cpus_per_node[node]++;
+            if (cpu + 1 > numa->n_cpus) numa->n_cpus = cpu + 1;
+        }
+        if (*p == ',') p++;
+    }
+}
+
+void detect_numa_topology(numa_topology* numa)
+{
+    char path[96];
+    char list[4096];
+    numa->n_nodes = 0;
+    numa->n_cpus = 0;
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++)
+        numa->node_of_cpu[cpu] = -1;
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++)
+    {
+        numa->online[node] = 0;
+        numa->cpus_per_node[node] = 0;
+    }
+
+    // Node ids can have gaps, so keep the highest node found
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (topology_read_line(path, list, sizeof(list)) != 0)
+            continue;
+        topology_parse_cpulist(numa, list, node);
+        numa->online[node] = 1;
+        numa->n_nodes = node + 1;
+    }
+
+    if (numa->n_nodes == 0)
+    {
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n_cpus > TOPOLOGY_MAX_CPUS) n_cpus = TOPOLOGY_MAX_CPUS;
+        for (int cpu = 0; cpu < n_cpus; cpu++)
+            numa->node_of_cpu[cpu] = 0;
+        numa->cpus_per_node[0] = n_cpus;
+        numa->online[0] = 1;
+        numa->n_cpus = n_cpus;
+        numa->n_nodes = 1;
+    }
+}
+
+int numa_node_of(numa_topology* numa, int cpu)
+{
+    if (cpu < 0 || cpu >= numa->n_cpus)
+        return -1;
+    return numa->node_of_cpu[cpu];
+}
+
+void print_numa_topology(numa_topology* numa)
+{
+    printf("NUMA Topology: %d Nodes", numa->n_nodes);
+    for (int node = 0; node < numa->n_nodes; node++)
+        if (numa->online[node])
+            printf(", Node %d %d CPUs", node, numa->cpus_per_node[node]);
+    printf("\n");
+}
+
+// The CPU the calling thread is running on, or -1 if unknown
+int current_cpu()
+{
+#if defined(__linux__) && defined(CPU_SET)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+// Restrict the calling thread to the CPUs of node
+// Returns 0 on success, -1 if binding is not supported or failed
+int bind_thread_to_node(numa_topology* numa, int node)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < numa->n_cpus; cpu++)
+        if (numa->node_of_cpu[cpu] == node)
+            CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+// Restrict the calling thread to a single CPU
+int bind_thread_to_cpu(int cpu)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+// Allow the calling thread to run on any CPU again
+int unbind_thread(numa_topology* numa)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < numa->n_cpus; cpu++)
+        if (numa->node_of_cpu[cpu] >= 0)
+            CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+// Place the (not yet touched) pages of ptr on node, with MPOL_BIND
+// ptr must be page aligned.  Returns 0 on success, -1 otherwise.
+int bind_memory_to_node(void* ptr, size_t bytes, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask[TOPOLOGY_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    const int mpol_bind = 2;
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_mbind, ptr, bytes, mpol_bind, mask, TOPOLOGY_MAX_NODES + 1, 0) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+#endif
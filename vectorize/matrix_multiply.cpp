@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <cmath>
 #include "../timer.h"
+#include "../benchmark.h"
+#include "../roofline.h"
+#include "../topology.h"
 
 // To compile with and without vectorization (in gcc):
 // gcc -o <executable_name> <file_name> -O1     <--- no vectorization
@@ -16,10 +19,10 @@
 
 // Matrix-Matrix Multiplication of Doubles (Double Pointer)
 // Test without the restrict variables
-void matmat(int n, double* __restrict__ A, double* __restrict__ B, double* __restrict__ C, int n_iter)
+void matmat(int n, double* __restrict__ A, double* __restrict__ B, double* __restrict__ C, long n_iter)
 {
     double val;
-    for (int iter = 0; iter < n_iter; iter++)
+    for (long iter = 0; iter < n_iter; iter++)
     {
         for (int i = 0; i < n; i++)
         {
@@ -39,6 +42,74 @@ void matmat(int n, double* __restrict__ A, double* __restrict__ B, double* __res
 }
 
 
+// Cache-blocked version of matmat, in tiles of tile x tile
+// A tile of each of A, B, and C is reused while it stays in cache
+void matmat_blocked(int n, double* __restrict__ A, double* __restrict__ B, double* __restrict__ C,
+        long n_iter, int tile)
+{
+    double val;
+    for (long iter = 0; iter < n_iter; iter++)
+    {
+        for (int i = 0; i < n*n; i++)
+            C[i] = 0;
+
+        for (int ii = 0; ii < n; ii += tile)
+        {
+            int i_end = ii + tile < n ? ii + tile : n;
+            for (int jj = 0; jj < n; jj += tile)
+            {
+                int j_end = jj + tile < n ? jj + tile : n;
+                for (int kk = 0; kk < n; kk += tile)
+                {
+                    int k_end = kk + tile < n ? kk + tile : n;
+                    for (int i = ii; i < i_end; i++)
+                    {
+                        for (int j = jj; j < j_end; j++)
+                        {
+                            val = A[i*n+j];
+                            for (int k = kk; k < k_end; k++)
+                                C[i*n+k] += val * B[j*n+k];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Largest tile (a multiple of the cache line) for which one tile each
+// of A, B, and C fit in L1 together
+int matmat_tile_size(cache_topology* topo)
+{
+    int line_dbl = topo->line_size / sizeof(double);
+    int tile = (int)sqrt(cache_size(topo, 1) / (3.0 * sizeof(double)));
+    tile = (tile / line_dbl) * line_dbl;
+    return tile > line_dbl ? tile : line_dbl;
+}
+
+
+// Everything matmat needs, so the benchmark harness can call it repeatedly
+struct matmat_args
+{
+    int n;
+    double* A;
+    double* B;
+    double* C;
+    int tile;
+};
+
+void matmat_kernel(void* data, long n_iter)
+{
+    matmat_args* args = (matmat_args*)data;
+    matmat(args->n, args->A, args->B, args->C, n_iter);
+}
+
+void matmat_blocked_kernel(void* data, long n_iter)
+{
+    matmat_args* args = (matmat_args*)data;
+    matmat_blocked(args->n, args->A, args->B, args->C, n_iter, args->tile);
+}
+
 
 // This program runs matrix matrix multiplication with double pointers
 // Test vectorization improvements for both doubles and floats
@@ -46,9 +117,6 @@ void matmat(int n, double* __restrict__ A, double* __restrict__ B, double* __res
 int main(int argc, char* argv[])
 {
 
-    double start, end;
-    int n_access = 1000000000;
-
     if (argc < 1)
     {
         printf("Need Matrix Dimemsion n passed as Command Line Arguments (e.g. ./matmat 8 2)\n");
@@ -57,11 +125,6 @@ int main(int argc, char* argv[])
 
     int n = atoi(argv[1]);
 
-    int n_iter;
-    if (n > 100) n_iter = 1;
-    else
-        n_iter = (n_access / (n*n*n));
-
     double* A = (double*)malloc(n*n*sizeof(double));
     double* B = (double*)malloc(n*n*sizeof(double));
     double* C = (double*)malloc(n*n*sizeof(double));
@@ -76,13 +139,47 @@ int main(int argc, char* argv[])
         }
     }
 
-    // Warm-Up 
-    matmat(n, A, B, C, n_iter);
+    // The number of multiplies per timing is calibrated, so small and large n
+    // both take a predictable amount of time (calibration also warms up)
+    cache_topology topo;
+    detect_cache_topology(&topo);
+    matmat_args args = {n, A, B, C, matmat_tile_size(&topo)};
+    benchmark_config config = default_benchmark_config();
+    benchmark_stats stats;
+    long n_iter = run_benchmark_calibrated(matmat_kernel, NULL, &args, config, &stats);
+    printf("N %d, MatMats Per Sample %ld, Time Per MatMat %e\n", n, n_iter, stats.median);
+    print_stats("Time Per MatMat", &stats);
+
+    // Energy per matmat, over a run long enough for the RAPL counters
+    energy_probe energy;
+    if (energy_init(&energy))
+    {
+        long n_energy = n_iter * config.min_samples;
+        double start = get_time();
+        energy_start(&energy);
+        matmat_kernel(&args, n_energy);
+        energy_stop(&energy);
+        double seconds = get_seconds(start, get_time());
+        print_energy("Energy", &energy, seconds, 2.0e-9*n*n*n*n_energy, "GFLOP");
+    }
 
-    start = get_time();
-    matmat(n, A, B, C, n_iter);
-    end = get_time();
-    printf("N %d, Time Per MatMat %e\n", n, (end - start)/n_iter);
+    // Blocked matmat, with tiles sized from the detected L1 cache
+    benchmark_stats blocked_stats;
+    long n_blocked = run_benchmark_calibrated(matmat_blocked_kernel, NULL, &args, config, &blocked_stats);
+    print_cache_topology(&topo);
+    printf("Tile %d, Blocked MatMats Per Sample %ld, Time Per Blocked MatMat %e\n",
+            args.tile, n_blocked, blocked_stats.median);
+    print_stats("Time Per Blocked MatMat", &blocked_stats);
+
+    // How close is matmat to the machine limit?
+    // 2n^3 flops, and at least A, B, and C must move to/from memory once
+    roofline_machine machine;
+    measure_roofline(&machine);
+    roofline_kernel kernels[2] = {
+        {"matmat", 2.0*n*n*n, 3.0*n*n*sizeof(double), stats.median},
+        {"matmat_blocked", 2.0*n*n*n, 3.0*n*n*sizeof(double), blocked_stats.median}};
+    print_roofline(&machine, kernels, 2);
+    write_roofline_csv("roofline.csv", &machine, kernels, 2);
 
 
 